@@ -0,0 +1,69 @@
+#pragma once
+
+#include "InetAddress.h"
+#include "AllocTracker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+
+/*
+    各个基准测试程序共用的小工具：
+        nowNanos   单调时钟的纳秒时间戳，用于计时和延迟统计
+        connectTo  客户端建立连接
+        checkAllocBudget  检查每条消息的堆分配次数（--max-allocs-per-msg）
+*/
+
+inline int64_t nowNanos(){
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// 阻塞地建立连接，再改成非阻塞交给 TcpConnection，失败时直接退出进程
+inline int connectTo(const InetAddress& server, InetAddress* local){
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || ::connect(fd, (const sockaddr*)server.getsockAddr(), sizeof(sockaddr_in)) < 0){
+        fprintf(stderr, "connect %s failed: %s\n", server.toIpPort().c_str(), strerror(errno));
+        exit(1);
+    }
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    sockaddr_in addr;
+    socklen_t len = sizeof addr;
+    ::getsockname(fd, (sockaddr*)&addr, &len);
+    *local = InetAddress(addr);
+    return fd;
+}
+
+/*
+函数功能：
+    计算测量期间每条消息的堆分配次数，格式化成 JSON 值写入 perMsgJson（没有数据时为 null），
+    maxAllocsPerMsg 不小于 0 时检查预算，返回进程的退出码：
+        0  通过或者不检查
+        2  无法检查：没有开启 MUDUO_ALLOC_TRACKER，或者没有完成任何消息
+        3  超出预算
+*/
+inline int checkAllocBudget(const char* role, const AllocTracker::Counts& allocs, uint64_t messages,
+                            double maxAllocsPerMsg, char* perMsgJson, size_t len){
+    snprintf(perMsgJson, len, "null");
+    if(AllocTracker::compiledIn() && messages > 0){
+        double perMsg = static_cast<double>(allocs.allocs) / messages;
+        snprintf(perMsgJson, len, "%.4f", perMsg);
+        if(maxAllocsPerMsg >= 0 && perMsg > maxAllocsPerMsg){
+            fprintf(stderr, "%s allocs_per_msg %.4f exceeds budget %.4f\n", role, perMsg, maxAllocsPerMsg);
+            return 3;
+        }
+    }else if(maxAllocsPerMsg >= 0){
+        fprintf(stderr, "--max-allocs-per-msg needs a build with MUDUO_ALLOC_TRACKER=ON and at least one message\n");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+
+/*
+    基准测试用的对数-线性直方图（HDR Histogram 的简化版），记录纳秒级延迟：
+        小于 128 的值每个值一个桶；之后每个 2 的幂区间分成 64 个桶，相对误差不超过 1/64
+        记录只是一次下标计算和一次自增，不分配内存，可以放在回调的热路径上
+        每个 loop 线程一个，测量结束后 merge 到一起再求分位数
+*/
+class Histogram {
+public:
+    Histogram()
+        : counts_(kNumBuckets, 0)
+        , count_(0)
+        , sum_(0)
+        , max_(0)
+    {}
+
+    void record(int64_t value){
+        uint64_t v = value > 0 ? static_cast<uint64_t>(value) : 0;
+        ++counts_[bucketIndex(v)];
+        ++count_;
+        sum_ += v;
+        max_ = std::max(max_, v);
+    }
+
+    void merge(const Histogram& other){
+        for(size_t i = 0; i < counts_.size(); ++i){
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset(){
+        std::fill(counts_.begin(), counts_.end(), 0);
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+    // q 取 0~1，返回所在桶的上界（不超过最大值）
+    uint64_t percentile(double q) const{
+        if(count_ == 0){
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(q * count_ + 0.5);
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for(size_t i = 0; i < counts_.size(); ++i){
+            seen += counts_[i];
+            if(seen >= rank){
+                return std::min(bucketUpperBound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_; }
+
+private:
+    static const int kSubBucketBits = 7;
+    static const uint64_t kSubBuckets = 1 << kSubBucketBits;        // 128
+    static const uint64_t kHalfSubBuckets = kSubBuckets / 2;        // 64
+    static const size_t kNumBuckets = kSubBuckets + (64 - kSubBucketBits) * kHalfSubBuckets;
+
+    static size_t bucketIndex(uint64_t v){
+        if(v < kSubBuckets){
+            return static_cast<size_t>(v);
+        }
+        int shift = (63 - __builtin_clzll(v)) - (kSubBucketBits - 1);     // 让 v >> shift 落在 [64, 128)
+        return static_cast<size_t>(kSubBuckets + (shift - 1) * kHalfSubBuckets + ((v >> shift) - kHalfSubBuckets));
+    }
+
+    static uint64_t bucketUpperBound(size_t index){
+        if(index < kSubBuckets){
+            return index;
+        }
+        uint64_t shift = (index - kSubBuckets) / kHalfSubBuckets + 1;
+        uint64_t sub = (index - kSubBuckets) % kHalfSubBuckets + kHalfSubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
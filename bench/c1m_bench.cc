@@ -0,0 +1,431 @@
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "MemoryBudget.h"
+#include "BenchUtil.h"
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+/*
+    连接规模（C1M）基准测试：一个进程能撑住多少空闲 / 低活跃连接，每个连接要多少内存
+
+    fork 出一个子进程做客户端（只用原始的 socket，不用本库），父进程运行 TcpServer，所有数据都在服务端进程内测量：
+        1. accept     子进程尽快建立 conns 个连接，源地址在 127.0.0.1 ~ 127.0.0.<sources> 之间轮换
+                      （每个源地址最多用掉 ip_local_port_range 那么多个端口），
+                      服务端统计从第一个到最后一个连接回调的时间，得到 accept 速率，以及每个连接花费的服务端 CPU 时间
+                      （客户端和服务端在同一台机器上，核数少时 accept 速率往往受限于客户端的 connect，cpu_us_per_conn 更能反映服务端）
+        2. memory     连接全部建立后，服务端进程的 RSS 增量 / 连接数，即每个 TcpConnection（含 Channel、Socket、
+                      两个 Buffer、TcpServer 连接表的槽位）在用户态占用的常驻内存；另外给出内核 TCP 占用的页数、
+                      sizeof(TcpConnection) 和此时所有连接缓冲区占用的内存，用来区分对象本身和缓冲区各占多少
+        3. idle/active  先空闲 seconds 秒，再由子进程以总速率 rate 随机挑连接发 16 字节的消息（服务端 echo），
+                      分别统计 epoll_wait 的次数、每次返回的事件数、每次循环花费的 CPU 时间
+        4. teardown   子进程一次性关闭所有连接，统计服务端从收到第一个断开到全部 connectDestroyed 的时间
+    结果输出一行 JSON。
+
+    用法（连接数超过几万时需要调大 ulimit -n，两个进程各占 conns 个 fd）：
+        c1m_bench --conns 100000 --threads 4 --sources 8 --rate 10000 --seconds 5
+*/
+namespace {
+
+struct Options{
+    uint16_t port = 9983;
+    int conns = 10000;
+    int threads = 1;
+    int sources = 0;                // 0 表示按 conns 自动计算
+    int rate = 1000;                // active 阶段每秒的消息数（所有连接合计）
+    int seconds = 3;
+};
+
+void usage(const char* prog){
+    fprintf(stderr, "usage: %s [--port N] [--conns N] [--threads N] [--sources N] [--rate N] [--seconds N]\n", prog);
+    exit(1);
+}
+
+Options parseOptions(int argc, char* argv[]){
+    static const struct option kLongOptions[] = {
+        { "port",    required_argument, nullptr, 'p' },
+        { "conns",   required_argument, nullptr, 'c' },
+        { "threads", required_argument, nullptr, 't' },
+        { "sources", required_argument, nullptr, 'S' },
+        { "rate",    required_argument, nullptr, 'r' },
+        { "seconds", required_argument, nullptr, 'd' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    Options opt;
+    int c;
+    while((c = getopt_long(argc, argv, "", kLongOptions, nullptr)) != -1){
+        switch(c){
+        case 'p': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 'c': opt.conns = atoi(optarg); break;
+        case 't': opt.threads = atoi(optarg); break;
+        case 'S': opt.sources = atoi(optarg); break;
+        case 'r': opt.rate = atoi(optarg); break;
+        case 'd': opt.seconds = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if(opt.conns <= 0 || opt.threads < 0 || opt.rate < 0 || opt.seconds <= 0 || opt.sources > 254){
+        usage(argv[0]);
+    }
+    if(opt.sources <= 0){
+        opt.sources = std::min(opt.conns / 25000 + 1, 254);    // 默认的本地端口范围大约 28000 个
+    }
+    return opt;
+}
+
+void raiseFdLimit(){
+    struct rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+long statusKb(const char* key){
+    FILE* fp = ::fopen("/proc/self/status", "r");
+    char line[256];
+    long value = -1;
+    size_t keyLen = strlen(key);
+    while(fp != nullptr && ::fgets(line, sizeof line, fp) != nullptr){
+        if(strncmp(line, key, keyLen) == 0 && line[keyLen] == ':'){
+            value = atol(line + keyLen + 1);
+            break;
+        }
+    }
+    if(fp != nullptr){
+        ::fclose(fp);
+    }
+    return value;
+}
+
+// /proc/net/sockstat 中 "TCP: ... mem N" 的 N，内核 TCP 缓冲区占用的页数（整个网络命名空间）
+long kernelTcpMemPages(){
+    FILE* fp = ::fopen("/proc/net/sockstat", "r");
+    char line[256];
+    long pages = -1;
+    while(fp != nullptr && ::fgets(line, sizeof line, fp) != nullptr){
+        const char* mem = strstr(line, " mem ");
+        if(strncmp(line, "TCP:", 4) == 0 && mem != nullptr){
+            pages = atol(mem + 5);
+        }
+    }
+    if(fp != nullptr){
+        ::fclose(fp);
+    }
+    return pages;
+}
+
+// 进程累计的 CPU 时间（所有线程，用户态 + 内核态），纳秒
+int64_t processCpuNanos(){
+    struct timespec ts;
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void writeByte(int fd, char c){
+    if(::write(fd, &c, 1) != 1){
+        perror("write pipe");
+        exit(1);
+    }
+}
+
+char readByte(int fd){
+    char c = 0;
+    if(::read(fd, &c, 1) != 1){
+        perror("read pipe");
+        exit(1);
+    }
+    return c;
+}
+
+}   // namespace
+
+
+/*
+    子进程：命令从 cmdFd 读入，'G' 开始建立连接（服务端 listen 之后才发），'A' 开始 active 阶段，
+    'C' 关闭所有连接并退出；每个阶段完成后往 ackFd 写一个字节
+*/
+namespace client {
+
+void connectAll(const Options& opt, std::vector<int>* fds){
+    sockaddr_in server;
+    memset(&server, 0, sizeof server);
+    server.sin_family = AF_INET;
+    server.sin_port = htons(opt.port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for(int i = 0; i < opt.conns; ++i){
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0){
+            fprintf(stderr, "client: socket failed after %d connections: %s\n", i, strerror(errno));
+            break;
+        }
+        sockaddr_in local;
+        memset(&local, 0, sizeof local);
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK + i % opt.sources);     // 127.0.0.1, 127.0.0.2, ...
+        // 只绑定源地址，端口推迟到 connect 时按四元组分配；否则 bind 端口 0 要在已占用的端口中逐个查找，
+        // 几千个连接之后客户端自己就成了瓶颈，测出来的不再是服务端的 accept 速率
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof on);
+        if(::bind(fd, (sockaddr*)&local, sizeof local) < 0
+            || ::connect(fd, (sockaddr*)&server, sizeof server) < 0){
+            fprintf(stderr, "client: connect failed after %d connections: %s\n", i, strerror(errno));
+            ::close(fd);
+            break;
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fds->push_back(fd);
+    }
+}
+
+// 每毫秒发出这一毫秒应发的消息，顺便把之前的回显读掉
+void runActive(const Options& opt, const std::vector<int>& fds){
+    const char message[16] = "c1m-bench-ping";
+    char sink[4096];
+    unsigned seed = 12345;
+    int64_t start = nowNanos();
+    int64_t end = start + static_cast<int64_t>(opt.seconds) * 1000000000;
+    uint64_t sent = 0;
+    for(int64_t now = start; now < end; now = nowNanos()){
+        uint64_t due = static_cast<uint64_t>((now - start) / 1e9 * opt.rate);
+        while(sent < due && !fds.empty()){
+            int fd = fds[rand_r(&seed) % fds.size()];
+            if(::write(fd, message, sizeof message) > 0){
+                while(::read(fd, sink, sizeof sink) > 0){
+                }
+            }
+            ++sent;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void run(const Options& opt, int cmdFd, int ackFd){
+    raiseFdLimit();
+    readByte(cmdFd);
+    std::vector<int> fds;
+    fds.reserve(opt.conns);
+    connectAll(opt, &fds);
+    writeByte(ackFd, 'R');
+
+    while(true){
+        char cmd = readByte(cmdFd);
+        if(cmd == 'A'){
+            runActive(opt, fds);
+            writeByte(ackFd, 'A');
+        }else{
+            for(int fd : fds){
+                ::close(fd);
+            }
+            writeByte(ackFd, 'C');
+            ::_exit(0);
+        }
+    }
+}
+
+}   // namespace client
+
+
+/*
+    父进程：服务端，以及所有的测量
+*/
+class C1mServer {
+public:
+    C1mServer(EventLoop* loop, const Options& opt)
+        : server_(loop, InetAddress(opt.port), "C1mServer")
+        , connected_(0)
+        , firstConnect_(0)
+        , lastConnect_(0)
+        , firstDisconnect_(0)
+        , lastDisconnect_(0)
+    {
+        server_.setConnectionCallback(std::bind(&C1mServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp){
+            conn->send(buf);
+        });
+        server_.setThreadNum(opt.threads);
+    }
+
+    void start(){ server_.start(); }
+
+    int connected() const { return connected_.load(std::memory_order_acquire); }
+    int64_t firstConnect() const { return firstConnect_.load(); }
+    int64_t lastConnect() const { return lastConnect_.load(); }
+    int64_t firstDisconnect() const { return firstDisconnect_.load(); }
+    int64_t lastDisconnect() const { return lastDisconnect_.load(); }
+
+private:
+    void onConnection(const TcpConnectionPtr& conn){
+        int64_t now = nowNanos();
+        if(conn->connected()){
+            int64_t zero = 0;
+            firstConnect_.compare_exchange_strong(zero, now);
+            lastConnect_.store(now);
+            connected_.fetch_add(1, std::memory_order_release);
+        }else{
+            int64_t zero = 0;
+            firstDisconnect_.compare_exchange_strong(zero, now);
+            lastDisconnect_.store(now);
+            connected_.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    TcpServer server_;
+    std::atomic<int> connected_;
+    std::atomic<int64_t> firstConnect_;
+    std::atomic<int64_t> lastConnect_;
+    std::atomic<int64_t> firstDisconnect_;
+    std::atomic<int64_t> lastDisconnect_;
+};
+
+
+// 一个阶段内 epoll_wait 的次数、平均返回的事件数、每次循环的 CPU 时间
+struct PhaseSample{
+    uint64_t waits;
+    double eventsSum;
+    int64_t cpuNanos;
+
+    static PhaseSample now(){
+        PhaseSample s;
+        s.waits = metrics::core().eventsPerWait.count();
+        s.eventsSum = metrics::core().eventsPerWait.sum();
+        s.cpuNanos = processCpuNanos();
+        return s;
+    }
+
+    // {"waits_per_sec":..,"events_per_wait":..,"cpu_us_per_wait":..}
+    static std::string json(const PhaseSample& begin, const PhaseSample& end, double seconds){
+        uint64_t waits = end.waits - begin.waits;
+        char buf[160];
+        snprintf(buf, sizeof buf, "{\"waits_per_sec\":%.1f,\"events_per_wait\":%.2f,\"cpu_us_per_wait\":%.3f}",
+                 waits / seconds, waits > 0 ? (end.eventsSum - begin.eventsSum) / waits : 0.0,
+                 waits > 0 ? (end.cpuNanos - begin.cpuNanos) / 1e3 / waits : 0.0);
+        return buf;
+    }
+};
+
+
+template <typename Pred>
+bool waitFor(Pred pred, int timeoutSeconds){
+    int64_t deadline = nowNanos() + static_cast<int64_t>(timeoutSeconds) * 1000000000;
+    while(!pred()){
+        if(nowNanos() > deadline){
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+
+int main(int argc, char* argv[]){
+    Options opt = parseOptions(argc, argv);
+    ::signal(SIGPIPE, SIG_IGN);
+    raiseFdLimit();
+    Logger::setLogLevel(FATAL);     // 客户端关闭时还有未读的回显会发 RST，不打印成千上万条 handleError
+
+    int cmdPipe[2];
+    int ackPipe[2];
+    if(::pipe(cmdPipe) < 0 || ::pipe(ackPipe) < 0){
+        perror("pipe");
+        return 1;
+    }
+
+    // 先 fork 再创建 loop 线程，子进程里没有本库的任何状态
+    pid_t child = ::fork();
+    if(child == 0){
+        ::close(cmdPipe[1]);
+        ::close(ackPipe[0]);
+        client::run(opt, cmdPipe[0], ackPipe[1]);
+    }
+    ::close(cmdPipe[0]);
+    ::close(ackPipe[1]);
+
+    EventLoop loop;
+    C1mServer server(&loop, opt);
+    server.start();
+    std::thread loopThread([&loop](){ loop.loop(); });
+
+    // 连接建立之前的基线：loop 线程都已经启动
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    long rssBefore = statusKb("VmRSS");
+    long tcpPagesBefore = kernelTcpMemPages();
+
+    // 1. accept
+    int64_t acceptCpuBegin = processCpuNanos();
+    writeByte(cmdPipe[1], 'G');
+    readByte(ackPipe[0]);
+    int clientConns = opt.conns;
+    bool allConnected = waitFor([&](){ return server.connected() >= clientConns; }, 10);
+    int established = server.connected();
+    double acceptSeconds = (server.lastConnect() - server.firstConnect()) / 1e9;
+    int64_t acceptCpuNanos = processCpuNanos() - acceptCpuBegin;
+
+    // 2. memory
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    long rssAfter = statusKb("VmRSS");
+    size_t bufferBytes = MemoryBudget::instance().used();      // 空闲连接的两个 Buffer 还没有分配内存时为 0
+    long tcpPagesAfter = kernelTcpMemPages();
+
+    // 3. idle / active
+    PhaseSample idleBegin = PhaseSample::now();
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    PhaseSample idleEnd = PhaseSample::now();
+
+    PhaseSample activeBegin = PhaseSample::now();
+    int64_t activeStart = nowNanos();
+    writeByte(cmdPipe[1], 'A');
+    readByte(ackPipe[0]);
+    PhaseSample activeEnd = PhaseSample::now();
+    double activeSeconds = (nowNanos() - activeStart) / 1e9;
+
+    // 4. teardown
+    writeByte(cmdPipe[1], 'C');
+    readByte(ackPipe[0]);
+    // 断开的连接回调在 TcpServer 把连接从连接表中删除之后（connectDestroyed 中）执行
+    bool allClosed = waitFor([&](){ return server.connected() == 0; }, 60);
+    double teardownSeconds = (server.lastDisconnect() - server.firstDisconnect()) / 1e9;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    long rssAfterTeardown = statusKb("VmRSS");
+    ::waitpid(child, nullptr, 0);
+
+    printf("{\"conns\":%d,\"established\":%d,\"threads\":%d,\"sources\":%d,"
+           "\"accept\":{\"seconds\":%.3f,\"per_sec\":%.1f,\"cpu_us_per_conn\":%.2f,\"complete\":%s},"
+           "\"memory\":{\"rss_before_kb\":%ld,\"rss_after_kb\":%ld,\"bytes_per_conn\":%.1f,"
+           "\"kernel_tcp_pages_per_conn\":%.3f,\"rss_after_teardown_kb\":%ld,"
+           "\"sizeof_tcp_connection\":%zu,\"buffer_bytes_per_conn\":%.1f},"
+           "\"idle\":%s,\"active\":%s,\"active_rate\":%d,"
+           "\"teardown\":{\"seconds\":%.3f,\"per_sec\":%.1f,\"complete\":%s}}\n",
+           opt.conns, established, opt.threads, opt.sources,
+           acceptSeconds, acceptSeconds > 0 ? established / acceptSeconds : 0.0,
+           established > 0 ? acceptCpuNanos / 1e3 / established : 0.0, allConnected ? "true" : "false",
+           rssBefore, rssAfter, established > 0 ? (rssAfter - rssBefore) * 1024.0 / established : 0.0,
+           established > 0 ? static_cast<double>(tcpPagesAfter - tcpPagesBefore) / established : 0.0, rssAfterTeardown,
+           sizeof(TcpConnection), established > 0 ? static_cast<double>(bufferBytes) / established : 0.0,
+           PhaseSample::json(idleBegin, idleEnd, opt.seconds).c_str(),
+           PhaseSample::json(activeBegin, activeEnd, activeSeconds).c_str(), opt.rate,
+           teardownSeconds, teardownSeconds > 0 ? established / teardownSeconds : 0.0, allClosed ? "true" : "false");
+    fflush(stdout);
+    ::_exit(0);
+}
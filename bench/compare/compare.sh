@@ -0,0 +1,127 @@
+#!/bin/bash
+#
+# 本库和原版 muduo 的对比测试：同一份 compare_server.cc 分别编译到两个库上，用同一个客户端（pingpong_client）
+# 跑相同的负载和线程数，得到吞吐、延迟，再从 /proc 读服务端进程的 CPU 时间和常驻内存，最后并排输出一张表。
+#
+# 负载：
+#     pingpong   1 个连接，64 字节一问一答，看单连接延迟
+#     echo       ECHO_CONNS 个连接，4096 字节的 pingpong，看吞吐
+#     chat       CHAT_CONNS 个连接，服务端把每条 64 字节的消息广播给所有连接，客户端每发一条等收齐 CHAT_CONNS 条
+#
+# 用法（在构建目录中运行，或用 BIN 指定可执行文件所在目录）：
+#     bench/compare/compare.sh
+#     THREADS="1 4" SECONDS_PER_RUN=10 MUDUO_SERVER=/path/to/compare_server_muduo bench/compare/compare.sh
+#
+# 原版 muduo 的服务端默认取 $BIN/compare_server_muduo（找到 muduo 时 CMake 会生成），不存在时只测本库。
+# 每组结果追加到 OUT（JSON Lines），表格打印到标准输出。
+
+set -e
+
+BIN=${BIN:-.}
+OUT=${OUT:-compare_output.jsonl}
+PORT=${PORT:-9990}
+THREADS=${THREADS:-"1 4"}
+WORKLOADS=${WORKLOADS:-"pingpong echo chat"}
+SECONDS_PER_RUN=${SECONDS_PER_RUN:-5}
+WARMUP=${WARMUP:-1}
+ECHO_CONNS=${ECHO_CONNS:-100}
+CHAT_CONNS=${CHAT_CONNS:-10}
+CLIENT_THREADS=${CLIENT_THREADS:-2}
+MUDUO_SERVER=${MUDUO_SERVER:-$BIN/compare_server_muduo}
+
+CLK_TCK=$(getconf CLK_TCK)
+
+IMPLS="muduocpp11"
+if [ -x "$MUDUO_SERVER" ]; then
+    IMPLS="$IMPLS muduo"
+else
+    echo "upstream muduo server ($MUDUO_SERVER) not found, measuring muduocpp11 only" >&2
+fi
+
+# 从一行 JSON 中取出数值字段（字段名唯一，不需要完整的 JSON 解析）
+field(){
+    grep -o "\"$2\":[0-9.]*" <<< "$1" | head -1 | cut -d: -f2
+}
+
+# 进程累计的 CPU 时间（用户态 + 内核态），单位为时钟滴答。comm 字段可能带空格，从最后一个 ')' 之后开始数
+cpu_ticks(){
+    sed 's/.*) //' "/proc/$1/stat" | awk '{ print $12 + $13 }'
+}
+
+status_kb(){
+    awk -v key="$2:" '$1 == key { print $2 }' "/proc/$1/status"
+}
+
+server_bin(){
+    if [ "$1" = muduo ]; then echo "$MUDUO_SERVER"; else echo "$BIN/compare_server"; fi
+}
+
+declare -A RESULT
+
+for workload in $WORKLOADS; do
+for threads in $THREADS; do
+for impl in $IMPLS; do
+    case $workload in
+        pingpong) server_mode=echo; client_args="--size 64 --conns 1" ;;
+        echo)     server_mode=echo; client_args="--size 4096 --conns $ECHO_CONNS" ;;
+        chat)     server_mode=chat; client_args="--size 64 --reply $((64 * CHAT_CONNS)) --conns $CHAT_CONNS" ;;
+        *) echo "unknown workload $workload" >&2; exit 1 ;;
+    esac
+
+    "$(server_bin $impl)" --port "$PORT" --threads "$threads" --mode "$server_mode" &
+    server=$!
+    sleep 0.3
+
+    client_out=$(mktemp)
+    "$BIN/pingpong_client" --port "$PORT" --mode pingpong $client_args --threads "$CLIENT_THREADS" \
+        --seconds "$SECONDS_PER_RUN" --warmup "$WARMUP" > "$client_out" &
+    client=$!
+
+    # 只统计客户端测量窗口内服务端的 CPU 时间
+    sleep "$WARMUP"
+    cpu_before=$(cpu_ticks $server)
+    wait $client
+    cpu_after=$(cpu_ticks $server)
+    rss_kb=$(status_kb $server VmRSS)
+    hwm_kb=$(status_kb $server VmHWM)
+    kill $server
+    wait $server 2>/dev/null || true
+
+    client_json=$(cat "$client_out")
+    rm -f "$client_out"
+    messages=$(field "$client_json" messages)
+    cpu_sec=$(awk -v t=$((cpu_after - cpu_before)) -v hz=$CLK_TCK 'BEGIN { printf "%.3f", t / hz }')
+    cpu_us_per_msg=$(awk -v s=$cpu_sec -v m=${messages:-0} 'BEGIN { printf "%.3f", (m > 0 ? s * 1e6 / m : 0) }')
+
+    echo "{\"impl\":\"$impl\",\"workload\":\"$workload\",\"threads\":$threads,\"server_cpu_sec\":$cpu_sec,\"cpu_us_per_msg\":$cpu_us_per_msg,\"rss_kb\":$rss_kb,\"hwm_kb\":$hwm_kb,\"client\":$client_json}" >> "$OUT"
+
+    key="$workload/$threads/$impl"
+    RESULT[$key.msgs]=$(field "$client_json" msgs_per_sec)
+    RESULT[$key.p50]=$(field "$client_json" p50)
+    RESULT[$key.p99]=$(field "$client_json" p99)
+    RESULT[$key.cpu]=$cpu_us_per_msg
+    RESULT[$key.rss]=$rss_kb
+    echo "done: impl=$impl workload=$workload threads=$threads" >&2
+done
+done
+done
+
+# 并排的报告：每个指标一列一个实现
+printf "%-10s %7s" workload threads
+for metric in msgs/s p50_us p99_us cpu_us/msg rss_kb; do
+    for impl in $IMPLS; do
+        printf " %18s" "$metric($impl)"
+    done
+done
+printf "\n"
+for workload in $WORKLOADS; do
+for threads in $THREADS; do
+    printf "%-10s %7s" $workload $threads
+    for metric in msgs p50 p99 cpu rss; do
+        for impl in $IMPLS; do
+            printf " %18s" "${RESULT[$workload/$threads/$impl.$metric]}"
+        done
+    done
+    printf "\n"
+done
+done
@@ -0,0 +1,143 @@
+/*
+    对比测试用的服务端，同一份代码分别编译到本库和原版 muduo 上：
+        不定义 MUDUO_UPSTREAM    链接本库，生成 compare_server
+        定义 MUDUO_UPSTREAM      链接原版 muduo（-lmuduo_net -lmuduo_base），生成 compare_server_muduo
+    两边的业务逻辑逐行相同，只有下面几行类型别名和 API 名字（retrieve/retrive、InetAddress 参数顺序）不同。
+
+    模式：
+        echo   收到什么回什么（send(Buffer*)），pingpong 和 echo 两种负载都用它
+        chat   把收到的数据原样广播给所有连接（跨线程 send），连接集合用一把锁保护，和 muduo 的 chat 例子一致
+
+    用法：
+        compare_server --port 9990 --threads 4 --mode echo
+    test/test_muduo/muduo_server.cpp 每条消息都要打印到 cout，不能直接用来压测，这里是它去掉打印、加上模式后的版本。
+*/
+#ifdef MUDUO_UPSTREAM
+    #include <muduo/net/TcpServer.h>
+    #include <muduo/net/EventLoop.h>
+    #include <muduo/base/Logging.h>
+
+    using muduo::net::TcpServer;
+    using muduo::net::EventLoop;
+    using muduo::net::InetAddress;
+    using muduo::net::TcpConnectionPtr;
+    using muduo::net::Buffer;
+    using muduo::Timestamp;
+
+    inline InetAddress listenAddress(uint16_t port){ return InetAddress(port); }
+    inline void retrieveAll(Buffer* buf){ buf->retrieveAll(); }
+    inline void quietLogging(){ muduo::Logger::setLogLevel(muduo::Logger::WARN); }
+#else
+    #include "TcpServer.h"
+    #include "EventLoop.h"
+    #include "Logger.h"
+
+    inline InetAddress listenAddress(uint16_t port){ return InetAddress(port, "0.0.0.0"); }
+    inline void retrieveAll(Buffer* buf){ buf->retriveAll(); }
+    inline void quietLogging(){ Logger::setLogLevel(ERROR); }
+#endif
+
+#include <set>
+#include <mutex>
+#include <string>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+
+namespace {
+
+struct Options{
+    uint16_t port = 9990;
+    int threads = 1;
+    std::string mode = "echo";
+};
+
+Options parseOptions(int argc, char* argv[]){
+    static const struct option kLongOptions[] = {
+        { "port",    required_argument, nullptr, 'p' },
+        { "threads", required_argument, nullptr, 't' },
+        { "mode",    required_argument, nullptr, 'm' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    Options opt;
+    int c;
+    while((c = getopt_long(argc, argv, "", kLongOptions, nullptr)) != -1){
+        switch(c){
+        case 'p': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 't': opt.threads = atoi(optarg); break;
+        case 'm': opt.mode = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [--port N] [--threads N] [--mode echo|chat]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if(opt.mode != "echo" && opt.mode != "chat"){
+        fprintf(stderr, "unknown mode %s\n", opt.mode.c_str());
+        exit(1);
+    }
+    return opt;
+}
+
+}   // namespace
+
+
+class CompareServer {
+public:
+    CompareServer(EventLoop* loop, const Options& opt)
+        : server_(loop, listenAddress(opt.port), "CompareServer")
+    {
+        server_.setConnectionCallback(std::bind(&CompareServer::onConnection, this, std::placeholders::_1));
+        if(opt.mode == "echo"){
+            server_.setMessageCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp){
+                conn->send(buf);
+            });
+        }else{
+            server_.setMessageCallback(
+                std::bind(&CompareServer::onChatMessage, this, std::placeholders::_1, std::placeholders::_2));
+        }
+        server_.setThreadNum(opt.threads);
+    }
+
+    void start(){ server_.start(); }
+
+private:
+    void onConnection(const TcpConnectionPtr& conn){
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(conn->connected()){
+            conn->setTcpNoDelay(true);
+            connections_.insert(conn);
+        }else{
+            connections_.erase(conn);
+        }
+    }
+
+    void onChatMessage(const TcpConnectionPtr&, Buffer* buf){
+        std::string message(buf->peek(), buf->readableBytes());
+        retrieveAll(buf);
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(const TcpConnectionPtr& conn : connections_){
+            conn->send(message.data(), message.size());
+        }
+    }
+
+    TcpServer server_;
+    std::mutex mutex_;
+    std::set<TcpConnectionPtr> connections_;
+};
+
+
+int main(int argc, char* argv[]){
+    Options opt = parseOptions(argc, argv);
+    ::signal(SIGPIPE, SIG_IGN);
+    quietLogging();
+
+    EventLoop loop;
+    CompareServer server(&loop, opt);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "../BenchUtil.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+
+
+/*
+    微基准测试的公共框架，每个 micro_* 程序只包含这个头文件和被测的库代码：
+        每个用例先跑一轮预热，然后按目标时长（默认 200 毫秒）估算迭代次数，重复 repeat 次（默认 7），
+        取每次 ns/op 的中位数作为结果，同时给出最小值和最大值，看波动是否可以接受
+        可以用 --cpu N 把线程绑到某个核上，减少调度带来的抖动
+    每个用例输出一行 JSON（JSON Lines），字段固定，便于和以前的结果逐行对比：
+        {"bench":"buffer","case":"append_retrive/64","ns_per_op":12.3,"min":12.1,"max":12.9,"iterations":16000000,"repeat":7}
+
+    用例函数的形式是 int64_t f(uint64_t iters)：执行 iters 次操作，返回这些操作花费的纳秒数。
+    一般直接用 MicroBench::timeLoop 计时整个循环；需要把准备工作排除在外时（比如 readFd 前先往管道里写数据），
+    用例自己只累加被测那一段的时间。
+*/
+class MicroBench {
+public:
+    using Case = std::function<int64_t(uint64_t iters)>;
+
+    MicroBench(const char* bench, int argc, char* argv[])
+        : bench_(bench)
+        , minTimeNanos_(200 * 1000 * 1000)
+        , repeat_(7)
+    {
+        for(int i = 1; i < argc; ++i){
+            if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc){
+                filter_ = argv[++i];
+            }else if(strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc){
+                minTimeNanos_ = atoll(argv[++i]) * 1000 * 1000;
+            }else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc){
+                repeat_ = std::max(atoi(argv[++i]), 1);
+            }else if(strcmp(argv[i], "--cpu") == 0 && i + 1 < argc){
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(atoi(argv[++i]), &set);
+                ::sched_setaffinity(0, sizeof set, &set);
+            }else{
+                fprintf(stderr, "usage: %s [--filter SUBSTR] [--min-time-ms N] [--repeat N] [--cpu N]\n", argv[0]);
+                exit(1);
+            }
+        }
+        if(!libraryOptimized()){
+            fprintf(stderr, "warning: library built without optimization, configure with -DCMAKE_BUILD_TYPE=Release\n");
+        }
+    }
+
+    // 阻止编译器把结果没有被使用的计算优化掉
+    template <typename T>
+    static void doNotOptimize(const T& value){
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    template <typename F>
+    static int64_t timeLoop(uint64_t iters, F body){
+        int64_t start = nowNanos();
+        for(uint64_t i = 0; i < iters; ++i){
+            body();
+            asm volatile("" : : : "memory");        // 循环体为空（比如被编译期去掉的日志）时，循环本身也不能被删掉
+        }
+        return nowNanos() - start;
+    }
+
+    bool selected(const std::string& name) const{
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+
+    void run(const std::string& name, const Case& f){
+        if(!selected(name)){
+            return;
+        }
+        // 预热，同时估算单次操作的耗时，据此确定迭代次数
+        uint64_t iters = 1;
+        int64_t elapsed = 0;
+        while(true){
+            elapsed = f(iters);
+            if(elapsed >= minTimeNanos_ / 10 || iters >= (1ULL << 40)){
+                break;
+            }
+            iters *= (elapsed > 0 ? std::min<int64_t>(std::max<int64_t>(minTimeNanos_ / 10 / elapsed, 2), 100) : 100);
+        }
+        double perOp = static_cast<double>(std::max<int64_t>(elapsed, 1)) / iters;
+        iters = static_cast<uint64_t>(std::min(std::max(minTimeNanos_ / perOp, 1.0), static_cast<double>(1ULL << 40)));
+
+        std::vector<double> samples;
+        for(int r = 0; r < repeat_; ++r){
+            samples.push_back(static_cast<double>(f(iters)) / iters);
+        }
+        std::sort(samples.begin(), samples.end());
+        printf("{\"bench\":\"%s\",\"case\":\"%s\",\"ns_per_op\":%.2f,\"min\":%.2f,\"max\":%.2f,"
+               "\"iterations\":%lu,\"repeat\":%d}\n",
+               bench_, name.c_str(), samples[samples.size() / 2], samples.front(), samples.back(), iters, repeat_);
+        fflush(stdout);
+    }
+
+    // 自己统计分布的用例（比如唤醒延迟）用这个输出，字段和 run 保持一致，另外带上分位数
+    void report(const std::string& name, double nsPerOp, double p50, double p99, double max, uint64_t iterations){
+        printf("{\"bench\":\"%s\",\"case\":\"%s\",\"ns_per_op\":%.2f,\"p50\":%.2f,\"p99\":%.2f,\"max\":%.2f,"
+               "\"iterations\":%lu,\"repeat\":1}\n",
+               bench_, name.c_str(), nsPerOp, p50, p99, max, iterations);
+        fflush(stdout);
+    }
+
+    int64_t minTimeNanos() const { return minTimeNanos_; }
+
+private:
+    // 库的编译选项看不到，用 CMake 传进来的 CMAKE_BUILD_TYPE 判断
+    static bool libraryOptimized(){
+#ifdef MUDUO_BENCH_BUILD_TYPE
+        return strcmp(MUDUO_BENCH_BUILD_TYPE, "Release") == 0 || strcmp(MUDUO_BENCH_BUILD_TYPE, "RelWithDebInfo") == 0;
+#else
+        return false;
+#endif
+    }
+
+    const char* bench_;
+    std::string filter_;
+    int64_t minTimeNanos_;
+    int repeat_;
+};
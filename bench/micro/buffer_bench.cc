@@ -0,0 +1,124 @@
+#include "Buffer.h"
+#include "MicroBench.h"
+
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+
+/*
+    Buffer 的微基准：
+        append_retrive/N        追加 N 字节再全部取走，最常见的收发路径，不触发 makeSpace
+        append_partial/N        每次追加 N 字节、取走 N/2，写满后 makeSpace 把剩余数据挪回头部（compact）
+        grow/N                  新建一个 Buffer 连续追加到 N 字节，测 makeSpace 的扩容（resize）路径
+        retriveAsString/N       取出 N 字节构造 std::string
+        readFd/msg=M,writable=W 管道里有 M 字节，读进一个可写空间为 W 的 Buffer；
+                                W < M 时多出的部分先读进栈上的 extrabuf 再 append。只计 readFd 本身的时间
+*/
+namespace {
+
+void benchAppendRetrive(MicroBench& bench, size_t n){
+    bench.run("append_retrive/" + std::to_string(n), [n](uint64_t iters){
+        Buffer buf;
+        std::string data(n, 'x');
+        return MicroBench::timeLoop(iters, [&](){
+            buf.append(data.data(), data.size());
+            MicroBench::doNotOptimize(buf.peek());
+            buf.retrive(n);
+        });
+    });
+}
+
+void benchAppendPartial(MicroBench& bench, size_t n){
+    bench.run("append_partial/" + std::to_string(n), [n](uint64_t iters){
+        Buffer buf;
+        std::string data(n, 'x');
+        return MicroBench::timeLoop(iters, [&](){
+            buf.append(data.data(), data.size());
+            buf.retrive(n / 2);
+            if(buf.readableBytes() > 16 * n){
+                buf.retriveAll();
+            }
+        });
+    });
+}
+
+void benchGrow(MicroBench& bench, size_t total){
+    bench.run("grow/" + std::to_string(total), [total](uint64_t iters){
+        char chunk[512] = {0};
+        return MicroBench::timeLoop(iters, [&](){
+            Buffer buf;
+            for(size_t written = 0; written < total; written += sizeof chunk){
+                buf.append(chunk, sizeof chunk);
+            }
+            MicroBench::doNotOptimize(buf.peek());
+        });
+    });
+}
+
+void benchRetriveAsString(MicroBench& bench, size_t n){
+    bench.run("retriveAsString/" + std::to_string(n), [n](uint64_t iters){
+        Buffer buf;
+        std::string data(n, 'x');
+        return MicroBench::timeLoop(iters, [&](){
+            buf.append(data.data(), data.size());
+            std::string s = buf.retriveAsString(n);
+            MicroBench::doNotOptimize(s.data());
+        });
+    });
+}
+
+void benchReadFd(MicroBench& bench, size_t msg, size_t writable){
+    bench.run("readFd/msg=" + std::to_string(msg) + ",writable=" + std::to_string(writable), [msg, writable](uint64_t iters){
+        int fds[2];
+        if(::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0){
+            perror("pipe2");
+            exit(1);
+        }
+        ::fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024);
+        std::string data(msg, 'x');
+        int64_t elapsed = 0;
+        for(uint64_t i = 0; i < iters; ++i){
+            Buffer buf(writable);       // 每次都是一个可写空间正好为 writable 的 Buffer
+            if(::write(fds[1], data.data(), data.size()) != static_cast<ssize_t>(data.size())){
+                perror("write");
+                exit(1);
+            }
+            int savedErrno = 0;
+            int64_t start = nowNanos();
+            ssize_t n = buf.readFd(fds[0], &savedErrno);
+            elapsed += nowNanos() - start;
+            MicroBench::doNotOptimize(n);
+        }
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return elapsed;
+    });
+}
+
+}   // namespace
+
+
+int main(int argc, char* argv[]){
+    MicroBench bench("buffer", argc, argv);
+
+    for(size_t n : { 16, 256, 4096, 65536 }){
+        benchAppendRetrive(bench, n);
+    }
+    for(size_t n : { 64, 1024 }){
+        benchAppendPartial(bench, n);
+    }
+    for(size_t n : { 4096, 65536 }){
+        benchGrow(bench, n);
+    }
+    for(size_t n : { 16, 1024 }){
+        benchRetriveAsString(bench, n);
+    }
+    for(size_t msg : { 512, 16384 }){
+        for(size_t writable : { 0, 1024, 65536 }){
+            benchReadFd(bench, msg, writable);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "Logger.h"
+#include "MicroBench.h"
+
+#include <string>
+
+
+/*
+    Logger 的微基准：
+        debug_compiled_out   LOG_DEBUG 在非 MUDEBUG 构建中被编译期去掉，应该和空循环一样
+        info_disabled        运行时级别为 ERROR 时的 LOG_INFO：一次 relaxed 原子读和一次分支
+        info_enabled         LOG_INFO 完整地格式化一行（时间戳前缀 + printf），输出到一个什么都不做的 sink，
+                             只测格式化本身，不含 write 系统调用
+*/
+namespace {
+
+void discardOutput(const char* msg, size_t len){
+    MicroBench::doNotOptimize(msg);
+    MicroBench::doNotOptimize(len);
+}
+
+void benchLogger(MicroBench& bench){
+    Logger::instance().setOutput(discardOutput);
+
+    bench.run("debug_compiled_out", [](uint64_t iters){
+        Logger::setLogLevel(DEBUG);
+        return MicroBench::timeLoop(iters, [](){
+            LOG_DEBUG("connection %s fd=%d bytes=%zu \n", "bench", 42, static_cast<size_t>(4096));
+        });
+    });
+
+    bench.run("info_disabled", [](uint64_t iters){
+        Logger::setLogLevel(ERROR);
+        return MicroBench::timeLoop(iters, [](){
+            LOG_INFO("connection %s fd=%d bytes=%zu \n", "bench", 42, static_cast<size_t>(4096));
+        });
+    });
+
+    bench.run("info_enabled", [](uint64_t iters){
+        Logger::setLogLevel(INFO);
+        return MicroBench::timeLoop(iters, [](){
+            LOG_INFO("connection %s fd=%d bytes=%zu \n", "bench", 42, static_cast<size_t>(4096));
+        });
+    });
+
+    Logger::setLogLevel(INFO);
+    Logger::instance().setOutput(nullptr);
+}
+
+}   // namespace
+
+
+int main(int argc, char* argv[]){
+    MicroBench bench("logger", argc, argv);
+    benchLogger(bench);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Logger.h"
+#include "MicroBench.h"
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+
+/*
+    EPollPoller::updateChannel 的微基准，在当前线程构造 EventLoop（不运行 loop），直接通过 Channel 操作：
+        mod_toggle/registered=N   enableWriting + disableWriting，两次 EPOLL_CTL_MOD
+        add_remove/registered=N   enableReading + disableAll + remove，一次 EPOLL_CTL_ADD、一次 EPOLL_CTL_DEL，
+                                  外加 ChannelMap 的插入和删除，相当于一个短连接在 poller 上的全部开销
+    registered 是 poller 中已经注册的其他 fd 的个数（eventfd），看 epoll 红黑树和 ChannelMap 变大以后的开销
+*/
+namespace {
+
+class Registered {
+public:
+    Registered(EventLoop* loop, int n){
+        for(int i = 0; i < n; ++i){
+            int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if(fd < 0){
+                perror("eventfd (raise ulimit -n)");
+                exit(1);
+            }
+            Channel* channel = new Channel(loop, fd);
+            channel->enableReading();
+            channels_.emplace_back(channel);
+        }
+    }
+
+    ~Registered(){
+        for(std::unique_ptr<Channel>& channel : channels_){
+            channel->disableAll();
+            channel->remove();
+            ::close(channel->getFd());
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<Channel>> channels_;
+};
+
+void benchModToggle(MicroBench& bench, EventLoop* loop, int registered){
+    bench.run("mod_toggle/registered=" + std::to_string(registered), [loop, registered](uint64_t iters){
+        Registered others(loop, registered);
+        int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        Channel channel(loop, fd);
+        channel.enableReading();
+        int64_t elapsed = MicroBench::timeLoop(iters, [&channel](){
+            channel.enableWriting();
+            channel.disableWriting();
+        });
+        channel.disableAll();
+        channel.remove();
+        ::close(fd);
+        return elapsed;
+    });
+}
+
+void benchAddRemove(MicroBench& bench, EventLoop* loop, int registered){
+    bench.run("add_remove/registered=" + std::to_string(registered), [loop, registered](uint64_t iters){
+        Registered others(loop, registered);
+        int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        Channel channel(loop, fd);
+        int64_t elapsed = MicroBench::timeLoop(iters, [&channel](){
+            channel.enableReading();
+            channel.disableAll();
+            channel.remove();
+        });
+        ::close(fd);
+        return elapsed;
+    });
+}
+
+}   // namespace
+
+
+int main(int argc, char* argv[]){
+    MicroBench bench("poller", argc, argv);
+    Logger::setLogLevel(ERROR);
+
+    struct rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+
+    EventLoop loop;
+    for(int registered : { 0, 1000, 10000 }){
+        if(static_cast<rlim_t>(registered) + 64 > limit.rlim_cur){
+            fprintf(stderr, "skip registered=%d: RLIMIT_NOFILE is %lu\n", registered, static_cast<unsigned long>(limit.rlim_cur));
+            continue;
+        }
+        benchModToggle(bench, &loop, registered);
+        benchAddRemove(bench, &loop, registered);
+    }
+    return 0;
+}
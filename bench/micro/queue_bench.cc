@@ -0,0 +1,108 @@
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "MicroBench.h"
+#include "../Histogram.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <chrono>
+
+
+/*
+    EventLoop::queueInLoop 的微基准，目标 loop 运行在一个 EventLoopThread 中：
+        queueInLoop/producers=P   P 个线程一共投递 iters 个回调，计到最后一个回调执行完为止，给出每个回调的平均耗时
+                                  （投递时 loop 可能正在执行上一批，一次 wakeup 会带走一批回调）
+        queueInLoop/same_thread   在 loop 线程自己的回调里投递，不需要 wakeup
+        wakeup_latency            loop 空闲（阻塞在 epoll_wait）时投递一个回调，测从投递到回调开始执行的时间，
+                                  逐个测量，输出中位数和 p99
+*/
+namespace {
+
+void benchCrossThread(MicroBench& bench, EventLoop* loop, int producers){
+    bench.run("queueInLoop/producers=" + std::to_string(producers), [loop, producers](uint64_t iters){
+        std::atomic<uint64_t> executed(0);
+        uint64_t perProducer = (iters + producers - 1) / producers;
+        uint64_t total = perProducer * producers;
+
+        int64_t start = nowNanos();
+        std::vector<std::thread> threads;
+        for(int p = 0; p < producers; ++p){
+            threads.emplace_back([loop, perProducer, &executed](){
+                for(uint64_t i = 0; i < perProducer; ++i){
+                    loop->queueInLoop([&executed](){ executed.fetch_add(1, std::memory_order_relaxed); });
+                }
+            });
+        }
+        for(std::thread& t : threads){
+            t.join();
+        }
+        while(executed.load(std::memory_order_acquire) < total){
+            std::this_thread::yield();
+        }
+        return (nowNanos() - start) * static_cast<int64_t>(iters) / static_cast<int64_t>(total);
+    });
+}
+
+void benchSameThread(MicroBench& bench, EventLoop* loop){
+    bench.run("queueInLoop/same_thread", [loop](uint64_t iters){
+        std::atomic<uint64_t> executed(0);
+        std::atomic<int64_t> elapsed(0);
+        loop->runInLoop([loop, iters, &executed, &elapsed](){
+            int64_t start = nowNanos();
+            for(uint64_t i = 0; i < iters; ++i){
+                loop->queueInLoop([&executed](){ executed.fetch_add(1, std::memory_order_relaxed); });
+            }
+            elapsed.store(nowNanos() - start);
+        });
+        while(executed.load(std::memory_order_acquire) < iters){
+            std::this_thread::yield();
+        }
+        return elapsed.load();
+    });
+}
+
+void benchWakeupLatency(MicroBench& bench, EventLoop* loop){
+    const std::string name = "wakeup_latency";
+    if(!bench.selected(name)){
+        return;
+    }
+    Histogram latency;
+    std::atomic<int64_t> ranAt(0);
+    int64_t deadline = nowNanos() + bench.minTimeNanos() * 5;
+    uint64_t samples = 0;
+    while(nowNanos() < deadline || samples < 1000){
+        // 让 loop 回到 epoll_wait 中再投递
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        ranAt.store(0, std::memory_order_relaxed);
+        int64_t queuedAt = nowNanos();
+        loop->queueInLoop([&ranAt](){ ranAt.store(nowNanos(), std::memory_order_release); });
+        int64_t t;
+        while((t = ranAt.load(std::memory_order_acquire)) == 0){
+            std::this_thread::yield();      // 只有一个核时不让出 CPU，loop 线程就要等到时间片用完
+        }
+        if(samples++ > 100){        // 丢掉最开始的样本
+            latency.record(t - queuedAt);
+        }
+    }
+    bench.report(name, latency.mean(), latency.percentile(0.5), latency.percentile(0.99), latency.max(), latency.count());
+}
+
+}   // namespace
+
+
+int main(int argc, char* argv[]){
+    MicroBench bench("queue", argc, argv);
+    Logger::setLogLevel(ERROR);
+
+    EventLoopThread thread;
+    EventLoop* loop = thread.startLoop();
+
+    benchCrossThread(bench, loop, 1);
+    benchCrossThread(bench, loop, 4);
+    benchSameThread(bench, loop);
+    benchWakeupLatency(bench, loop);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include "Timestamp.h"
+#include "MicroBench.h"
+
+#include <string>
+
+
+/*
+    Timestamp 的微基准（Logger 每行日志都要取一次时间并格式化）：
+        now                 Timestamp::now()，走 vDSO
+        toString            秒级格式化，走线程缓存的日期前缀
+        toFormattedString   带微秒的格式化
+        formatTo            格式化到调用者的缓冲区，不构造 std::string
+*/
+namespace {
+
+void benchTimestamp(MicroBench& bench){
+    bench.run("now", [](uint64_t iters){
+        return MicroBench::timeLoop(iters, [](){
+            MicroBench::doNotOptimize(Timestamp::now());
+        });
+    });
+
+    // 用当前时间格式化，和日志的实际用法一致（同一秒内命中线程缓存）
+    Timestamp now = Timestamp::now();
+    bench.run("toString", [now](uint64_t iters){
+        return MicroBench::timeLoop(iters, [now](){
+            std::string s = now.toString();
+            MicroBench::doNotOptimize(s.data());
+        });
+    });
+
+    bench.run("toFormattedString", [now](uint64_t iters){
+        return MicroBench::timeLoop(iters, [now](){
+            std::string s = now.toFormattedString();
+            MicroBench::doNotOptimize(s.data());
+        });
+    });
+
+    bench.run("formatTo", [now](uint64_t iters){
+        char buf[64];
+        return MicroBench::timeLoop(iters, [now, &buf](){
+            MicroBench::doNotOptimize(now.formatTo(buf, sizeof buf));
+        });
+    });
+}
+
+}   // namespace
+
+
+int main(int argc, char* argv[]){
+    MicroBench bench("timestamp", argc, argv);
+    benchTimestamp(bench);
+    return 0;
+}
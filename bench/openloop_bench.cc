@@ -0,0 +1,472 @@
+#include "TcpServer.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "EventLoopThreadPool.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Logger.h"
+#include "Histogram.h"
+#include "BenchUtil.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+
+
+/*
+    开环（open-loop）延迟基准测试：
+        发送按固定的时间表进行，和响应是否返回无关；延迟从 "计划发送时间" 开始算，而不是实际发送时间。
+        服务端变慢时，排队等待的时间也会计入延迟，不会像 pingpong 那样因为客户端跟着变慢而被掩盖（coordinated omission）
+
+    每个客户端 loop 线程用一个 timerfd 按时间表触发，把到期的请求轮流发到自己的连接上，
+    每个连接用一个队列记录已发出请求的计划时间，收齐 reply 字节就弹出一个，把 now - 计划时间 记入直方图。
+
+    对每个速率档位：预热 warmup 秒，测量 seconds 秒，停发后等待在途请求返回（最多 drain 秒），输出一行 JSON：
+        目标速率、实际发送/完成速率、p50/p90/p99/p99.9/max（微秒）
+    某一档在 drain 时间内没有收完，说明服务端已经过了饱和点，记录下来后停止扫描。
+
+    服务端默认在进程内启动（--server-threads 个 subloop），处理函数可选：
+        echo   回显请求
+        fixed  每个请求回复 reply 字节
+        spin   每个请求先忙等 work-us 微秒再回复 reply 字节，模拟有计算量的业务
+    --server-threads -1 表示不启动，直接压测 --host/--port 上已有的服务（比如 pingpong_server）。
+
+    用法：
+        openloop_bench --rates 10000,50000,100000,200000 --conns 16 --client-threads 2 --server-threads 4
+*/
+namespace {
+
+struct Options{
+    std::string host = "127.0.0.1";
+    uint16_t port = 9982;
+    std::vector<double> rates = { 10000, 20000, 50000, 100000 };
+    size_t size = 64;
+    size_t reply = 0;               // 0 表示和 size 相同
+    int conns = 16;
+    int clientThreads = 1;
+    int serverThreads = 1;          // -1 表示不启动进程内服务端
+    std::string handler = "echo";
+    int workUs = 0;
+    int seconds = 5;
+    int warmup = 1;
+    int drain = 2;
+};
+
+void usage(const char* prog){
+    fprintf(stderr, "usage: %s [--host IP] [--port N] [--rates R1,R2,...] [--size BYTES] [--reply BYTES] [--conns N] "
+                    "[--client-threads N] [--server-threads N|-1] [--handler echo|fixed|spin] [--work-us N] "
+                    "[--seconds N] [--warmup N] [--drain N]\n", prog);
+    exit(1);
+}
+
+std::vector<double> parseRates(const char* s){
+    std::vector<double> rates;
+    while(*s != '\0'){
+        char* end;
+        double r = strtod(s, &end);
+        if(end == s || r <= 0){
+            return std::vector<double>();
+        }
+        rates.push_back(r);
+        s = (*end == ',') ? end + 1 : end;
+    }
+    return rates;
+}
+
+Options parseOptions(int argc, char* argv[]){
+    static const struct option kLongOptions[] = {
+        { "host",           required_argument, nullptr, 'h' },
+        { "port",           required_argument, nullptr, 'p' },
+        { "rates",          required_argument, nullptr, 'R' },
+        { "size",           required_argument, nullptr, 's' },
+        { "reply",          required_argument, nullptr, 'r' },
+        { "conns",          required_argument, nullptr, 'c' },
+        { "client-threads", required_argument, nullptr, 't' },
+        { "server-threads", required_argument, nullptr, 'T' },
+        { "handler",        required_argument, nullptr, 'H' },
+        { "work-us",        required_argument, nullptr, 'W' },
+        { "seconds",        required_argument, nullptr, 'd' },
+        { "warmup",         required_argument, nullptr, 'w' },
+        { "drain",          required_argument, nullptr, 'D' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    Options opt;
+    int c;
+    while((c = getopt_long(argc, argv, "", kLongOptions, nullptr)) != -1){
+        switch(c){
+        case 'h': opt.host = optarg; break;
+        case 'p': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 'R': opt.rates = parseRates(optarg); break;
+        case 's': opt.size = static_cast<size_t>(atol(optarg)); break;
+        case 'r': opt.reply = static_cast<size_t>(atol(optarg)); break;
+        case 'c': opt.conns = atoi(optarg); break;
+        case 't': opt.clientThreads = atoi(optarg); break;
+        case 'T': opt.serverThreads = atoi(optarg); break;
+        case 'H': opt.handler = optarg; break;
+        case 'W': opt.workUs = atoi(optarg); break;
+        case 'd': opt.seconds = atoi(optarg); break;
+        case 'w': opt.warmup = atoi(optarg); break;
+        case 'D': opt.drain = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if(opt.rates.empty() || opt.size == 0 || opt.conns <= 0 || opt.clientThreads <= 0 || opt.seconds <= 0
+        || (opt.handler != "echo" && opt.handler != "fixed" && opt.handler != "spin")){
+        usage(argv[0]);
+    }
+    if(opt.reply == 0 || opt.handler == "echo"){
+        opt.reply = opt.size;
+    }
+    return opt;
+}
+
+
+// 在 loop 线程中执行 f，等它执行完再返回
+void runAndWait(EventLoop* loop, const std::function<void()>& f){
+    std::promise<void> done;
+    loop->runInLoop([&f, &done](){
+        f();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+}   // namespace
+
+
+/*
+    进程内的服务端：请求定长 size 字节，按 handler 回复
+*/
+class BenchServer {
+public:
+    BenchServer(EventLoop* loop, const Options& opt)
+        : server_(loop, InetAddress(opt.port), "OpenLoopServer")
+        , opt_(opt)
+        , replyPayload_(opt.reply, 'r')
+    {
+        server_.setConnectionCallback([](const TcpConnectionPtr& conn){
+            if(conn->connected()){
+                conn->setTcpNoDelay(true);
+            }
+        });
+        if(opt.handler == "echo"){
+            server_.setMessageCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp){
+                conn->send(buf);
+            });
+        }else{
+            server_.setMessageCallback(
+                std::bind(&BenchServer::onRequest, this, std::placeholders::_1, std::placeholders::_2));
+        }
+        server_.setThreadNum(opt.serverThreads);
+    }
+
+    void start(){ server_.start(); }
+
+private:
+    void onRequest(const TcpConnectionPtr& conn, Buffer* buf){
+        while(buf->readableBytes() >= opt_.size){
+            buf->retrive(opt_.size);
+            if(opt_.workUs > 0){
+                int64_t until = nowNanos() + static_cast<int64_t>(opt_.workUs) * 1000;
+                while(nowNanos() < until){
+                }
+            }
+            conn->send(replyPayload_.data(), replyPayload_.size());
+        }
+    }
+
+    TcpServer server_;
+    const Options opt_;
+    const std::string replyPayload_;
+};
+
+
+/*
+    一个客户端 loop 线程上的发送器，所有成员只在该 loop 线程中访问（包括 start/stop/collect，都通过 runAndWait 调用）
+*/
+class Generator {
+public:
+    struct Result{
+        Histogram latency;
+        uint64_t sent = 0;              // 计划时间落在测量窗口内、已发出的请求数
+        uint64_t completed = 0;         // 其中已经收到回复的
+        uint64_t timedOut = 0;          // 其中 drain 超时后仍未收到回复的，和 latency 统计同一个窗口
+        uint64_t outstanding = 0;       // 所有在途请求（包括预热阶段发出的）
+    };
+
+    Generator(EventLoop* loop, const Options& opt)
+        : opt_(opt)
+        , message_(opt.size, 'm')
+        , timerfd_(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
+        , timerChannel_(new Channel(loop, timerfd_))
+        , active_(false)
+        , interval_(0)
+        , nextSend_(0)
+        , measureFrom_(0)
+        , measureUntil_(0)
+        , next_(0)
+    {
+        if(timerfd_ < 0){
+            LOG_FATAL("timerfd_create failed, errno:%d \n", errno);
+        }
+    }
+
+    // 以下在 loop 线程中调用
+    void init(){
+        timerChannel_->setReadCallback(std::bind(&Generator::onTimer, this));
+        timerChannel_->enableReading();
+    }
+
+    void addConnection(const TcpConnectionPtr& conn){
+        std::shared_ptr<ConnState> state = std::make_shared<ConnState>();
+        state->conn = conn;
+        conn->setMessageCallback(
+            std::bind(&Generator::onMessage, this, state.get(), std::placeholders::_2));
+        conns_.push_back(state);
+    }
+
+    // 按每秒 rate 个请求发送，第一个请求的计划时间是 firstSend；计划时间在 [measureFrom, measureUntil) 内的请求计入结果
+    void start(double rate, int64_t firstSend, int64_t measureFrom, int64_t measureUntil){
+        result_ = Result();
+        result_.outstanding = outstanding();
+        interval_ = 1e9 / rate;
+        nextSend_ = static_cast<double>(firstSend);
+        measureFrom_ = measureFrom;
+        measureUntil_ = measureUntil;
+        active_ = true;
+        armTimer();
+    }
+
+    void stop(){
+        active_ = false;
+    }
+
+    Result collect(){
+        result_.outstanding = outstanding();
+        return result_;
+    }
+
+    // drain 超时后仍未返回的请求：按至少已经等了 now - 计划时间 记入直方图，不能当作没发生过
+    void recordTimedOut(int64_t now){
+        for(const std::shared_ptr<ConnState>& state : conns_){
+            for(int64_t intended : state->intended){
+                if(intended >= measureFrom_ && intended < measureUntil_){
+                    ++result_.timedOut;
+                    result_.latency.record(now - intended);
+                }
+            }
+        }
+    }
+
+private:
+    struct ConnState{
+        TcpConnectionPtr conn;
+        std::deque<int64_t> intended;       // 已发出、尚未收到回复的请求的计划发送时间
+    };
+
+    uint64_t outstanding() const{
+        uint64_t n = 0;
+        for(const std::shared_ptr<ConnState>& state : conns_){
+            n += state->intended.size();
+        }
+        return n;
+    }
+
+    void armTimer(){
+        int64_t when = static_cast<int64_t>(nextSend_);
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof spec);
+        spec.it_value.tv_sec = when / 1000000000;
+        spec.it_value.tv_nsec = when % 1000000000;
+        ::timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    // 发出所有计划时间已到的请求，即使发送已经落后于时间表也要一次补齐，落后的时间会体现在延迟里
+    void onTimer(){
+        uint64_t expirations;
+        ::read(timerfd_, &expirations, sizeof expirations);
+        if(!active_ || conns_.empty()){
+            return;
+        }
+        int64_t now = nowNanos();
+        while(nextSend_ <= now){
+            int64_t intended = static_cast<int64_t>(nextSend_);
+            ConnState* state = conns_[next_++ % conns_.size()].get();
+            state->intended.push_back(intended);
+            state->conn->send(message_.data(), message_.size());
+            if(intended >= measureFrom_ && intended < measureUntil_){
+                ++result_.sent;
+            }
+            nextSend_ += interval_;
+        }
+        armTimer();
+    }
+
+    void onMessage(ConnState* state, Buffer* buf){
+        int64_t now = nowNanos();
+        while(buf->readableBytes() >= opt_.reply && !state->intended.empty()){
+            buf->retrive(opt_.reply);
+            int64_t intended = state->intended.front();
+            state->intended.pop_front();
+            if(intended >= measureFrom_ && intended < measureUntil_){
+                ++result_.completed;
+                result_.latency.record(now - intended);
+            }
+        }
+    }
+
+    const Options& opt_;
+    const std::string message_;
+    int timerfd_;
+    std::unique_ptr<Channel> timerChannel_;
+    std::vector<std::shared_ptr<ConnState>> conns_;
+    Result result_;
+    bool active_;
+    double interval_;
+    double nextSend_;
+    int64_t measureFrom_;
+    int64_t measureUntil_;
+    size_t next_;
+};
+
+
+int main(int argc, char* argv[]){
+    Options opt = parseOptions(argc, argv);
+    ::signal(SIGPIPE, SIG_IGN);
+    Logger::setLogLevel(ERROR);
+
+    EventLoopThread serverThread;
+    std::unique_ptr<BenchServer> server;
+    if(opt.serverThreads >= 0){
+        server.reset(new BenchServer(serverThread.startLoop(), opt));
+        server->start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    // 客户端 loop 线程把定时器精度（timer slack）调到 1 纳秒，默认的 50 微秒会直接叠加到低负载时的延迟上
+    EventLoop baseLoop;     // 只用来构造线程池，不运行
+    EventLoopThreadPool pool(&baseLoop, "openloop");
+    pool.setThreadNum(opt.clientThreads);
+    pool.start([](EventLoop*){ ::prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0); });
+    std::vector<EventLoop*> loops = pool.getAllLoops();
+
+    std::vector<std::unique_ptr<Generator>> generators;
+    for(EventLoop* loop : loops){
+        Generator* gen = new Generator(loop, opt);
+        generators.emplace_back(gen);
+        runAndWait(loop, std::bind(&Generator::init, gen));
+    }
+
+    InetAddress serverAddr(opt.port, opt.host);
+    std::shared_ptr<const std::string> namePrefix = std::make_shared<const std::string>("openloop");
+    for(int i = 0; i < opt.conns; ++i){
+        InetAddress local;
+        int fd = connectTo(serverAddr, &local);
+        EventLoop* loop = loops[i % loops.size()];
+        Generator* gen = generators[i % loops.size()].get();
+
+        TcpConnectionPtr conn = std::make_shared<TcpConnection>(loop, i + 1, namePrefix, fd, local, serverAddr);
+        conn->setConnectionCallback([](const TcpConnectionPtr& c){
+            if(c->connected()){
+                c->setTcpNoDelay(true);
+            }
+        });
+        conn->setCloseCallback([](const TcpConnectionPtr& c){
+            c->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, c));
+        });
+        runAndWait(loop, [gen, conn](){
+            gen->addConnection(conn);
+            conn->connectEstablished();
+        });
+    }
+
+    for(double rate : opt.rates){
+        // 各个 loop 的时间表依次错开 1/rate 秒，合起来是间隔均匀的 rate 个/秒
+        double perLoopRate = rate / loops.size();
+        int64_t start = nowNanos() + 10 * 1000000;
+        int64_t measureFrom = start + static_cast<int64_t>(opt.warmup) * 1000000000;
+        int64_t measureUntil = measureFrom + static_cast<int64_t>(opt.seconds) * 1000000000;
+        for(size_t i = 0; i < loops.size(); ++i){
+            int64_t firstSend = start + static_cast<int64_t>(1e9 / rate * i);
+            Generator* gen = generators[i].get();
+            runAndWait(loops[i], [=](){ gen->start(perLoopRate, firstSend, measureFrom, measureUntil); });
+        }
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(measureUntil - nowNanos()));
+        for(size_t i = 0; i < loops.size(); ++i){
+            runAndWait(loops[i], std::bind(&Generator::stop, generators[i].get()));
+        }
+
+        // 等在途请求返回
+        int64_t drainUntil = nowNanos() + static_cast<int64_t>(opt.drain) * 1000000000;
+        std::vector<Generator::Result> results(loops.size());
+        uint64_t outstanding;
+        do{
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            outstanding = 0;
+            for(size_t i = 0; i < loops.size(); ++i){
+                Generator* gen = generators[i].get();
+                runAndWait(loops[i], [gen, &results, i](){ results[i] = gen->collect(); });
+                outstanding += results[i].outstanding;
+            }
+        }while(outstanding > 0 && nowNanos() < drainUntil);
+
+        if(outstanding > 0){
+            int64_t now = nowNanos();
+            for(size_t i = 0; i < loops.size(); ++i){
+                Generator* gen = generators[i].get();
+                runAndWait(loops[i], [gen, &results, i, now](){
+                    gen->recordTimedOut(now);
+                    results[i] = gen->collect();
+                });
+            }
+        }
+
+        Histogram latency;
+        uint64_t sent = 0;
+        uint64_t completed = 0;
+        uint64_t timedOut = 0;
+        for(const Generator::Result& r : results){
+            latency.merge(r.latency);
+            sent += r.sent;
+            completed += r.completed;
+            timedOut += r.timedOut;
+        }
+        printf("{\"rate\":%.0f,\"size\":%lu,\"reply\":%lu,\"conns\":%d,\"client_threads\":%d,\"server_threads\":%d,"
+               "\"handler\":\"%s\",\"work_us\":%d,\"seconds\":%d,\"sent_per_sec\":%.1f,\"completed_per_sec\":%.1f,"
+               "\"timed_out\":%lu,\"latency_us\":{\"mean\":%.2f,\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"p999\":%.2f,"
+               "\"max\":%.2f}}\n",
+               rate, opt.size, opt.reply, opt.conns, opt.clientThreads, opt.serverThreads,
+               opt.handler.c_str(), opt.workUs, opt.seconds,
+               static_cast<double>(sent) / opt.seconds, static_cast<double>(completed) / opt.seconds, timedOut,
+               latency.mean() / 1e3, latency.percentile(0.5) / 1e3, latency.percentile(0.9) / 1e3,
+               latency.percentile(0.99) / 1e3, latency.percentile(0.999) / 1e3, latency.max() / 1e3);
+        fflush(stdout);
+
+        // 这一档已经收不完了，连接上还有积压，后面更高的档位没有意义
+        if(outstanding > 0){
+            fprintf(stderr, "saturated at %.0f req/s (%lu requests still outstanding after %ds drain)\n",
+                    rate, outstanding, opt.drain);
+            break;
+        }
+    }
+    ::_exit(0);     // 连接和 loop 线程不做逐个析构
+}
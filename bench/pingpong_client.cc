@@ -0,0 +1,257 @@
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
+#include "Logger.h"
+#include "AllocTracker.h"
+#include "Histogram.h"
+#include "BenchUtil.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+
+/*
+    基准测试的客户端，本身也用这个库实现（TcpConnection + EventLoopThreadPool）：
+        pingpong  每个连接同时只有一个请求：发送 size 字节，收齐 reply 字节后记录往返延迟，再发下一个
+        discard   每个连接不停地发送 size 字节的消息，写完一批（WriteCompleteCallback）接着写，只统计发送吞吐
+    conns 个连接轮流分配到 threads 个 loop 线程上。先预热 warmup 秒，再测量 seconds 秒，输出一行 JSON：
+        msgs/s、MB/s（按请求方向计算）、延迟分位数（微秒），开启 MUDUO_ALLOC_TRACKER 时还有客户端每条消息的堆分配次数
+    指定 --max-allocs-per-msg 时，每条消息的堆分配次数超过该值（或者没有开启 MUDUO_ALLOC_TRACKER）则以非 0 退出，供 CI 检查
+
+    用法：
+        pingpong_client --port 9981 --mode pingpong --size 4096 --conns 100 --threads 4 --seconds 10
+*/
+namespace {
+
+struct Options{
+    std::string host = "127.0.0.1";
+    uint16_t port = 9981;
+    std::string mode = "pingpong";
+    size_t size = 4096;
+    size_t reply = 0;               // 服务端的回复大小，0 表示和 size 相同（echo）
+    int conns = 1;
+    int threads = 1;
+    int seconds = 10;
+    int warmup = 1;
+    double maxAllocsPerMsg = -1;    // 小于 0 表示不检查
+};
+
+void usage(const char* prog){
+    fprintf(stderr, "usage: %s [--host IP] [--port N] [--mode pingpong|discard] [--size BYTES] [--reply BYTES] "
+                    "[--conns N] [--threads N] [--seconds N] [--warmup N] [--max-allocs-per-msg N]\n", prog);
+    exit(1);
+}
+
+Options parseOptions(int argc, char* argv[]){
+    static const struct option kLongOptions[] = {
+        { "host",    required_argument, nullptr, 'h' },
+        { "port",    required_argument, nullptr, 'p' },
+        { "mode",    required_argument, nullptr, 'm' },
+        { "size",    required_argument, nullptr, 's' },
+        { "reply",   required_argument, nullptr, 'r' },
+        { "conns",   required_argument, nullptr, 'c' },
+        { "threads", required_argument, nullptr, 't' },
+        { "seconds", required_argument, nullptr, 'd' },
+        { "warmup",  required_argument, nullptr, 'w' },
+        { "max-allocs-per-msg", required_argument, nullptr, 'a' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    Options opt;
+    int c;
+    while((c = getopt_long(argc, argv, "", kLongOptions, nullptr)) != -1){
+        switch(c){
+        case 'h': opt.host = optarg; break;
+        case 'p': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 'm': opt.mode = optarg; break;
+        case 's': opt.size = static_cast<size_t>(atol(optarg)); break;
+        case 'r': opt.reply = static_cast<size_t>(atol(optarg)); break;
+        case 'c': opt.conns = atoi(optarg); break;
+        case 't': opt.threads = atoi(optarg); break;
+        case 'd': opt.seconds = atoi(optarg); break;
+        case 'w': opt.warmup = atoi(optarg); break;
+        case 'a': opt.maxAllocsPerMsg = atof(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if((opt.mode != "pingpong" && opt.mode != "discard") || opt.size == 0 || opt.conns <= 0 || opt.threads <= 0){
+        usage(argv[0]);
+    }
+    if(opt.reply == 0){
+        opt.reply = opt.size;
+    }
+    return opt;
+}
+
+}   // namespace
+
+
+// 每个 loop 线程一份，只在该线程中修改，测量结束、线程退出后再汇总
+struct LoopStats{
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    Histogram latency;
+};
+
+
+class PingpongClient {
+public:
+    PingpongClient(EventLoop* baseLoop, const Options& opt)
+        : opt_(opt)
+        , message_(opt.size, 'm')
+        , pool_(new EventLoopThreadPool(baseLoop, "bench"))
+        , stats_(opt.threads)
+        , measuring_(false)
+        , stopping_(false)
+    {
+        pool_->setThreadNum(opt.threads);
+    }
+
+    void start(){
+        pool_->start();
+        std::vector<EventLoop*> loops = pool_->getAllLoops();
+        InetAddress server(opt_.port, opt_.host);
+        std::shared_ptr<const std::string> namePrefix = std::make_shared<const std::string>("bench");
+        for(int i = 0; i < opt_.conns; ++i){
+            InetAddress local;
+            int fd = connectTo(server, &local);
+            EventLoop* loop = loops[i % loops.size()];
+            LoopStats* stats = &stats_[i % loops.size()];
+
+            TcpConnectionPtr conn = std::make_shared<TcpConnection>(loop, i + 1, namePrefix, fd, local, server);
+            std::shared_ptr<int64_t> sentAt = std::make_shared<int64_t>(0);
+            conn->setConnectionCallback(std::bind(&PingpongClient::onConnection, this, std::placeholders::_1, sentAt));
+            conn->setMessageCallback(
+                std::bind(&PingpongClient::onMessage, this, std::placeholders::_1, std::placeholders::_2, stats, sentAt));
+            conn->setWriteCompleteCallback(std::bind(&PingpongClient::onWriteComplete, this, std::placeholders::_1, stats));
+            conn->setCloseCallback([](const TcpConnectionPtr& c){
+                c->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, c));
+            });
+            conns_.push_back(conn);
+            loop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+        }
+    }
+
+    void setMeasuring(bool on){ measuring_.store(on, std::memory_order_relaxed); }
+
+    // 停止发送并退出所有 loop 线程，之后才能安全地读取 stats_
+    void stop(){
+        stopping_.store(true, std::memory_order_relaxed);
+        pool_.reset();
+    }
+
+    const std::vector<LoopStats>& stats() const { return stats_; }
+
+private:
+    void onConnection(const TcpConnectionPtr& conn, const std::shared_ptr<int64_t>& sentAt){
+        if(conn->connected()){
+            conn->setTcpNoDelay(true);
+            *sentAt = nowNanos();
+            conn->send(message_.data(), message_.size());
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr& conn, Buffer* buf, LoopStats* stats, const std::shared_ptr<int64_t>& sentAt){
+        if(opt_.mode == "discard"){
+            buf->retriveAll();
+            return;
+        }
+        while(buf->readableBytes() >= opt_.reply){
+            buf->retrive(opt_.reply);
+            int64_t now = nowNanos();
+            if(measuring_.load(std::memory_order_relaxed)){
+                ++stats->messages;
+                stats->bytes += opt_.size;
+                stats->latency.record(now - *sentAt);
+            }
+            if(!stopping_.load(std::memory_order_relaxed)){
+                *sentAt = now;
+                conn->send(message_.data(), message_.size());
+            }
+        }
+    }
+
+    // discard 模式：上一条消息完全写入内核后接着发下一条，保证发送缓冲区一直有数据
+    void onWriteComplete(const TcpConnectionPtr& conn, LoopStats* stats){
+        if(opt_.mode != "discard" || stopping_.load(std::memory_order_relaxed)){
+            return;
+        }
+        if(measuring_.load(std::memory_order_relaxed)){
+            ++stats->messages;
+            stats->bytes += opt_.size;
+        }
+        conn->send(message_.data(), message_.size());
+    }
+
+    const Options opt_;
+    const std::string message_;
+    std::unique_ptr<EventLoopThreadPool> pool_;
+    std::vector<LoopStats> stats_;
+    std::vector<TcpConnectionPtr> conns_;
+    std::atomic_bool measuring_;
+    std::atomic_bool stopping_;
+};
+
+
+int main(int argc, char* argv[]){
+    Options opt = parseOptions(argc, argv);
+    ::signal(SIGPIPE, SIG_IGN);
+    Logger::setLogLevel(ERROR);
+
+    EventLoop baseLoop;     // 只用来构造线程池，不运行
+    PingpongClient client(&baseLoop, opt);
+    client.start();
+
+    std::this_thread::sleep_for(std::chrono::seconds(opt.warmup));
+    AllocTracker::Counts allocsBefore = AllocTracker::totalCounts();
+    int64_t start = nowNanos();
+    client.setMeasuring(true);
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    client.setMeasuring(false);
+    int64_t end = nowNanos();
+    AllocTracker::Counts allocs = AllocTracker::totalCounts() - allocsBefore;
+    client.stop();
+
+    Histogram latency;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    for(const LoopStats& s : client.stats()){
+        messages += s.messages;
+        bytes += s.bytes;
+        latency.merge(s.latency);
+    }
+
+    double seconds = (end - start) / 1e9;
+    char allocsPerMsg[32];
+    int status = checkAllocBudget("client", allocs, messages, opt.maxAllocsPerMsg, allocsPerMsg, sizeof allocsPerMsg);
+    printf("{\"role\":\"client\",\"mode\":\"%s\",\"size\":%lu,\"reply\":%lu,\"conns\":%d,\"threads\":%d,\"seconds\":%.3f,"
+           "\"messages\":%lu,\"msgs_per_sec\":%.1f,\"mb_per_sec\":%.3f,",
+           opt.mode.c_str(), opt.size, opt.reply, opt.conns, opt.threads, seconds,
+           messages, messages / seconds, bytes / seconds / (1024 * 1024));
+    if(opt.mode == "pingpong"){
+        printf("\"latency_us\":{\"mean\":%.2f,\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"p999\":%.2f,\"max\":%.2f},",
+               latency.mean() / 1e3, latency.percentile(0.5) / 1e3, latency.percentile(0.9) / 1e3,
+               latency.percentile(0.99) / 1e3, latency.percentile(0.999) / 1e3, latency.max() / 1e3);
+    }else{
+        printf("\"latency_us\":null,");
+    }
+    printf("\"allocs_per_msg\":%s}\n", allocsPerMsg);
+    fflush(stdout);
+    ::_exit(status);    // 连接的析构不在测量范围内，直接退出
+}
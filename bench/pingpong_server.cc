@@ -0,0 +1,174 @@
+#include "TcpServer.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "AllocTracker.h"
+#include "BenchUtil.h"
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+
+/*
+    基准测试的服务端，三种模式：
+        echo      收到什么回什么（send(Buffer*)，不拷贝、不分配）
+        discard   只读不回，测单向吞吐
+        fixed     每收到 size 字节的请求，回复 reply 字节的固定内容
+    运行 seconds 秒后退出（0 表示一直运行），退出时输出一行 JSON：
+        测量窗口（warmup 之后）内读到的字节数，以及开启 MUDUO_ALLOC_TRACKER 时每条消息的堆分配次数
+
+    用法：
+        pingpong_server --port 9981 --threads 4 --mode echo --size 4096 --seconds 10 --warmup 2
+*/
+namespace {
+
+struct Options{
+    uint16_t port = 9981;
+    int threads = 1;
+    std::string mode = "echo";
+    size_t size = 4096;             // 请求大小，fixed 模式用来切分请求，其他模式用来把字节数折算成消息数
+    size_t reply = 4096;            // fixed 模式的回复大小
+    int seconds = 0;
+    int warmup = 1;
+    double maxAllocsPerMsg = -1;    // 小于 0 表示不检查，见 pingpong_client
+};
+
+void usage(const char* prog){
+    fprintf(stderr, "usage: %s [--port N] [--threads N] [--mode echo|discard|fixed] [--size BYTES] "
+                    "[--reply BYTES] [--seconds N] [--warmup N] [--max-allocs-per-msg N]\n", prog);
+    exit(1);
+}
+
+Options parseOptions(int argc, char* argv[]){
+    static const struct option kLongOptions[] = {
+        { "port",    required_argument, nullptr, 'p' },
+        { "threads", required_argument, nullptr, 't' },
+        { "mode",    required_argument, nullptr, 'm' },
+        { "size",    required_argument, nullptr, 's' },
+        { "reply",   required_argument, nullptr, 'r' },
+        { "seconds", required_argument, nullptr, 'd' },
+        { "warmup",  required_argument, nullptr, 'w' },
+        { "max-allocs-per-msg", required_argument, nullptr, 'a' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    Options opt;
+    int c;
+    while((c = getopt_long(argc, argv, "", kLongOptions, nullptr)) != -1){
+        switch(c){
+        case 'p': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 't': opt.threads = atoi(optarg); break;
+        case 'm': opt.mode = optarg; break;
+        case 's': opt.size = static_cast<size_t>(atol(optarg)); break;
+        case 'r': opt.reply = static_cast<size_t>(atol(optarg)); break;
+        case 'd': opt.seconds = atoi(optarg); break;
+        case 'w': opt.warmup = atoi(optarg); break;
+        case 'a': opt.maxAllocsPerMsg = atof(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if((opt.mode != "echo" && opt.mode != "discard" && opt.mode != "fixed") || opt.size == 0){
+        usage(argv[0]);
+    }
+    return opt;
+}
+
+}   // namespace
+
+
+class PingpongServer {
+public:
+    PingpongServer(EventLoop* loop, const Options& opt)
+        : server_(loop, InetAddress(opt.port), "PingpongServer")
+        , opt_(opt)
+        , replyPayload_(opt.reply, 'r')
+    {
+        server_.setConnectionCallback([](const TcpConnectionPtr& conn){
+            if(conn->connected()){
+                conn->setTcpNoDelay(true);
+            }
+        });
+        if(opt.mode == "echo"){
+            server_.setMessageCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp){
+                conn->send(buf);
+            });
+        }else if(opt.mode == "discard"){
+            server_.setMessageCallback([](const TcpConnectionPtr&, Buffer* buf, Timestamp){
+                buf->retriveAll();
+            });
+        }else{
+            server_.setMessageCallback(
+                std::bind(&PingpongServer::onFixedMessage, this, std::placeholders::_1, std::placeholders::_2));
+        }
+        server_.setThreadNum(opt.threads);
+    }
+
+    void start(){ server_.start(); }
+
+private:
+    // 请求可能被拆开或粘在一起，按 size 切分，每个完整的请求回复一次
+    void onFixedMessage(const TcpConnectionPtr& conn, Buffer* buf){
+        while(buf->readableBytes() >= opt_.size){
+            buf->retrive(opt_.size);
+            conn->send(replyPayload_.data(), replyPayload_.size());
+        }
+    }
+
+    TcpServer server_;
+    const Options opt_;
+    const std::string replyPayload_;
+};
+
+
+int main(int argc, char* argv[]){
+    Options opt = parseOptions(argc, argv);
+    ::signal(SIGPIPE, SIG_IGN);
+    Logger::setLogLevel(ERROR);
+
+    EventLoop loop;
+    PingpongServer server(&loop, opt);
+    server.start();
+
+    uint64_t bytesBefore = 0;
+    uint64_t bytesAfter = 0;
+    AllocTracker::Counts allocsBefore;
+    AllocTracker::Counts allocsAfter;
+    double measured = 0;
+    std::thread timer;
+    if(opt.seconds > 0){
+        timer = std::thread([&](){
+            std::this_thread::sleep_for(std::chrono::seconds(opt.warmup));
+            bytesBefore = metrics::core().bytesRead.value();
+            allocsBefore = AllocTracker::totalCounts();
+            auto start = std::chrono::steady_clock::now();
+
+            std::this_thread::sleep_for(std::chrono::seconds(std::max(opt.seconds - opt.warmup, 1)));
+            bytesAfter = metrics::core().bytesRead.value();
+            allocsAfter = AllocTracker::totalCounts();
+            measured = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            loop.quit();
+        });
+    }
+    loop.loop();
+    if(timer.joinable()){
+        timer.join();
+    }
+
+    uint64_t bytes = bytesAfter - bytesBefore;
+    uint64_t messages = bytes / opt.size;
+    AllocTracker::Counts allocs = allocsAfter - allocsBefore;
+    char allocsPerMsg[32];
+    int status = checkAllocBudget("server", allocs, messages, opt.maxAllocsPerMsg, allocsPerMsg, sizeof allocsPerMsg);
+    printf("{\"role\":\"server\",\"mode\":\"%s\",\"threads\":%d,\"size\":%lu,\"reply\":%lu,\"seconds\":%.3f,"
+           "\"bytes_in\":%lu,\"messages\":%lu,\"allocs_per_msg\":%s}\n",
+           opt.mode.c_str(), opt.threads, opt.size, opt.mode == "fixed" ? opt.reply : opt.size, measured,
+           bytes, messages, allocsPerMsg);
+    fflush(stdout);
+    ::_exit(status);    // 连接还在各个 loop 中，直接退出，不做逐个析构
+}
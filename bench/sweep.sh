@@ -0,0 +1,69 @@
+#!/bin/bash
+#
+# 在本机回环上扫描 消息大小 × 连接数 × 线程数，每个组合启动一次服务端和客户端，
+# 两边各输出一行 JSON（role 为 server/client），全部追加到 OUT 文件（JSON Lines）中。
+#
+# 用法（在构建目录中运行，或用 BIN 指定可执行文件所在目录）：
+#     bench/sweep.sh
+#     SIZES="64 4096" CONNS="1 100" THREADS="1 4" MODES="echo fixed" SECONDS_PER_RUN=5 bench/sweep.sh
+#
+# 模式：echo（pingpong，服务端原样返回）、fixed（pingpong，服务端回复 REPLY 字节）、discard（只发不收）
+#
+# 设置 MAX_ALLOCS_PER_MSG 时（需要 -DMUDUO_ALLOC_TRACKER=ON 构建），任何一个组合中服务端或客户端每条消息的
+# 堆分配次数超过该值，脚本就以非 0 退出，用于 CI 中拦截稳态分配的回退：
+#     MAX_ALLOCS_PER_MSG=0.01 SIZES=4096 CONNS=10 THREADS=1 bench/sweep.sh
+
+set -e
+
+BIN=${BIN:-.}
+OUT=${OUT:-bench_output.jsonl}
+PORT=${PORT:-9981}
+SIZES=${SIZES:-"16 256 4096 65536"}
+CONNS=${CONNS:-"1 10 100"}
+THREADS=${THREADS:-"1 2 4"}
+MODES=${MODES:-"echo"}
+REPLY=${REPLY:-64}
+SECONDS_PER_RUN=${SECONDS_PER_RUN:-5}
+WARMUP=${WARMUP:-1}
+MAX_ALLOCS_PER_MSG=${MAX_ALLOCS_PER_MSG:-}
+
+ALLOC_ARGS=""
+if [ -n "$MAX_ALLOCS_PER_MSG" ]; then
+    ALLOC_ARGS="--max-allocs-per-msg $MAX_ALLOCS_PER_MSG"
+fi
+
+for mode in $MODES; do
+for size in $SIZES; do
+for conns in $CONNS; do
+for threads in $THREADS; do
+    case $mode in
+        echo)    client_mode=pingpong; reply=$size ;;
+        fixed)   client_mode=pingpong; reply=$REPLY ;;
+        discard) client_mode=discard;  reply=$size ;;
+        *) echo "unknown mode $mode" >&2; exit 1 ;;
+    esac
+
+    # 服务端多跑 2 秒，保证客户端的测量窗口内服务端一直在
+    "$BIN/pingpong_server" --port "$PORT" --threads "$threads" --mode "$mode" --size "$size" --reply "$reply" \
+        --seconds $((WARMUP + SECONDS_PER_RUN + 2)) --warmup "$WARMUP" $ALLOC_ARGS >> "$OUT" &
+    server=$!
+    sleep 0.3
+
+    "$BIN/pingpong_client" --port "$PORT" --mode "$client_mode" --size "$size" --reply "$reply" \
+        --conns "$conns" --threads "$threads" --seconds "$SECONDS_PER_RUN" --warmup "$WARMUP" $ALLOC_ARGS >> "$OUT" || {
+        status=$?
+        kill "$server" 2>/dev/null || true
+        wait "$server" 2>/dev/null || true
+        echo "FAILED: client mode=$mode size=$size conns=$conns threads=$threads (exit $status)" >&2
+        exit $status
+    }
+    wait "$server" || {
+        status=$?
+        echo "FAILED: server mode=$mode size=$size conns=$conns threads=$threads (exit $status)" >&2
+        exit $status
+    }
+    echo "done: mode=$mode size=$size conns=$conns threads=$threads" >&2
+done
+done
+done
+done
@@ -3,11 +3,11 @@
 #include "noncopyable.h"
 #include "Socket.h"
 #include "Channel.h"
+#include "InetAddress.h"
 
 #include <functional>
 
 class EventLoop;
-class InetAddress;
 
 /*
     Acceptor 类功能梳理：
@@ -29,6 +29,10 @@ public:
     void setNewConnectionCallback(const NewConnectionCallback& cb){ newConnectionCallback_ = cb; }
     
     bool getListenning() const { return listenning_; }
+
+    // 监听地址不是通配地址（0.0.0.0）时，所有连接的本端地址都等于监听地址，不需要每个连接调用一次 getsockname
+    bool hasFixedLocalAddr() const { return fixedLocalAddr_; }
+    const InetAddress& getLocalAddr() const { return localAddr_; }     // 绑定后的实际地址（端口为 0 时是内核分配的端口）
     
     void listen();
 
@@ -40,5 +44,7 @@ private:
     Channel acceptChannel_;                             // listenfd 对应的 channel
     NewConnectionCallback newConnectionCallback_;       // 新连接回调，该回调是用 TcpServer 设置的
     bool listenning_;                                   // 是否正在监听
+    InetAddress localAddr_;
+    bool fixedLocalAddr_;
 };
 
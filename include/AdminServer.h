@@ -0,0 +1,48 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+
+#include <functional>
+#include <string>
+#include <map>
+
+
+/*
+    AdminServer 类功能梳理（可选的管理端口）：
+        1. 基于 TcpServer 的极简 HTTP/1.0 服务，只处理 GET，每个请求回复后关闭连接
+        2. 按路径分发到注册的处理函数，内置 /metrics（Prometheus 文本格式）、/trace（Chrome trace JSON）和 /（列出所有路径），
+           addStatusRoute 注册 /status（JSON），包含 server 各个 loop 的状态和占用内存最多的连接
+        3. 处理函数通过 Responder 回复，Responder 可以在任意线程、稍后调用一次（比如等各个 loop 汇总完数据）
+
+    建议给 AdminServer 一个单独的 EventLoop（线程），采集和格式化都在这个线程中完成，不占用 I/O 线程
+*/
+class AdminServer: public noncopyable {
+public:
+    using Responder = std::function<void(const std::string& contentType, const std::string& body)>;
+    using Handler = std::function<void(const std::string& query, const Responder& respond)>;
+
+    AdminServer(EventLoop* loop, const InetAddress& listenAddr, const std::string& name = "AdminServer");
+
+    // 注册路径（不含查询字符串），在 start 之前调用
+    void addRoute(const std::string& path, const Handler& handler);
+    /*
+        注册 /status。采集不阻塞任何线程：向 server 的每个 loop 投递一个采集任务，再向 baseloop 投递连接排序任务，
+        最后一个完成的任务负责拼 JSON 并回复。server 必须比 AdminServer 活得久
+        同时开启 server 各个 loop 的回调耗时统计（EventLoop::enableStats）；/status?reset=1 在读取后开始新的统计窗口
+    */
+    void addStatusRoute(TcpServer* server, size_t topConnections = 10);
+    void start();
+
+private:
+    void onConnection(const TcpConnectionPtr& conn);
+    void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp receiveTime);
+
+    static void reply(const TcpConnectionPtr& conn, const char* status,
+                      const std::string& contentType, const std::string& body);
+
+    static const size_t kMaxRequestSize = 8*1024;
+
+    TcpServer server_;
+    std::map<std::string, Handler> routes_;
+};
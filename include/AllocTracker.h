@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+
+/*
+    AllocTracker 堆分配统计（可选，CMake 选项 MUDUO_ALLOC_TRACKER，默认关闭）：
+        1. 开启后库中替换了全局的 operator new/delete，每次分配只累加当前线程的计数（没有锁，没有共享缓存行）
+        2. 每个线程有一个“当前站点”，分配计到该站点上：
+               EventLoop 按阶段设置 EventLoop::poll / EventLoop::io / EventLoop::functors，
+               库中容易分配的地方（投递任务的 std::function/std::bind、retriveAllAsString 的 std::string 等）
+               用 MUDUO_ALLOC_SITE 标注更细的站点，作用域结束后恢复外层站点
+        3. 基准测试在预热后取一次 totalCounts()，跑完再取一次，相减除以消息数就是每条消息的分配次数，
+           超过预算时让基准测试失败，从而在 CI 中发现稳态分配的回归
+
+    未开启时 MUDUO_ALLOC_SITE 为空宏，compiledIn() 返回 false，各个计数都是 0
+*/
+class AllocTracker {
+public:
+    struct Counts{
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t bytes;         // 分配的字节数（按 malloc_usable_size 计算）
+
+        Counts() : allocs(0), frees(0), bytes(0) {}
+        Counts operator-(const Counts& rhs) const;
+    };
+
+    static bool compiledIn();
+
+    static Counts threadCounts();       // 当前线程
+    static Counts totalCounts();        // 所有线程之和
+
+    // 各个站点的分配次数和字节数（所有线程之和，frees 不按站点统计），按分配次数从多到少
+    static std::vector<std::pair<std::string, Counts>> siteCounts();
+
+    // 按线程、按站点的文本报告
+    static std::string report();
+
+    // 设置当前线程的站点（必须是字符串常量），返回原来的站点
+    static const char* exchangeSite(const char* site);
+
+    // RAII 的站点，用 MUDUO_ALLOC_SITE 声明
+    class Site: public noncopyable {
+    public:
+        explicit Site(const char* site) : prev_(exchangeSite(site)) {}
+        ~Site() { exchangeSite(prev_); }
+
+    private:
+        const char* prev_;
+    };
+};
+
+
+#ifdef MUDUO_ALLOC_TRACKER
+#define MUDUO_ALLOC_SITE(name)      AllocTracker::Site muduoAllocSite(name)
+#define MUDUO_ALLOC_SET_SITE(name)  AllocTracker::exchangeSite(name)
+#else
+#define MUDUO_ALLOC_SITE(name)      do {} while(0)
+#define MUDUO_ALLOC_SET_SITE(name)  do {} while(0)
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string.h>         // memcpy
+#include <sys/types.h>      // off_t
+
+
+/*
+    AsyncLogger 类功能梳理（双缓冲异步日志）：
+        前端：任意线程调用 append，只在锁内把日志 memcpy 到 currentBuffer_，写满后放入 buffers_，换上 nextBuffer_
+        后端：单独的线程每隔 flushInterval_ 秒（或有写满的缓冲区时）把 buffers_ 整个换出来，
+             在锁外批量写入 LogFile，再把两块空缓冲区还给前端
+        所以 LOG_* 宏所在的 I/O 线程永远不会阻塞在磁盘上。
+
+    start() 之后 Logger 的输出就切换到当前对象，应当在 TcpServer::start 之前调用。一个进程只应有一个 AsyncLogger
+*/
+class AsyncLogger: public noncopyable {
+public:
+    AsyncLogger(const std::string& basename, off_t rollSize, int flushInterval = 3);
+    ~AsyncLogger();
+
+    void append(const char* logline, size_t len);
+    void flush();       // 阻塞，直到目前已经 append 的日志都写入文件（用于 LOG_FATAL）
+
+    void start();
+    void stop();
+
+private:
+    static const size_t kBufferSize = 4*1024*1024;
+
+    // 定长的日志缓冲区
+    class LogBuffer: public noncopyable {
+    public:
+        LogBuffer() : cur_(data_) {}
+
+        void append(const char* buf, size_t len){
+            if(avail() > len){
+                memcpy(cur_, buf, len);
+                cur_ += len;
+            }
+        }
+
+        const char* data() const { return data_; }
+        size_t length() const { return static_cast<size_t>(cur_ - data_); }
+        size_t avail() const { return static_cast<size_t>(data_ + sizeof data_ - cur_); }
+        void reset() { cur_ = data_; }
+
+    private:
+        char data_[kBufferSize];
+        char* cur_;
+    };
+
+    using BufferPtr = std::unique_ptr<LogBuffer>;
+    using BufferVector = std::vector<BufferPtr>;
+
+    void threadFunc();
+
+    static void output(const char* msg, size_t len);     // 作为 Logger 的输出函数
+    static void flushOutput();
+
+    const int flushInterval_;
+    std::atomic_bool running_;
+    const std::string basename_;
+    const off_t rollSize_;
+    Thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable flushedCond_;
+    BufferPtr currentBuffer_;
+    BufferPtr nextBuffer_;
+    BufferVector buffers_;                      // 已写满，等待后端写入文件的缓冲区
+    uint64_t flushRequested_;                   // flush() 请求的序号
+    uint64_t flushCompleted_;                   // 后端已经完成的 flush 序号
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>         // memcpy、strlen
+#include <time.h>
+#include <sys/types.h>      // off_t
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>      // __rdtsc
+#endif
+
+class LogFile;
+
+
+/*
+    BinaryLogger 类功能梳理（延迟格式化的二进制日志）：
+        1. 每个 LOG_* 调用点第一次执行时调用 registerSite 登记 级别/文件/行号/格式串，得到一个静态的 siteId
+        2. 热路径上只把 siteId、时间戳（TSC）和原始参数拷贝进当前线程的环形缓冲区（单生产者单消费者，无锁）
+           环形缓冲区写满时丢弃这条日志并计数，永远不会阻塞
+        3. 后端线程定期把各个线程的环形缓冲区搬到文件中，同时写入调用点的定义和 TSC 校准点
+        4. 由单独的解码工具（tools/logdecoder.cc）离线把二进制日志还原成文本
+
+    文件格式（小端）：
+        文件头      "MUDUOBL1"
+        之后是一系列条目，每个条目以 1 字节的类型开头：
+            kEntrySite      u32 id | u8 level | u32 line | u16 fileLen | file | u16 fmtLen | fmt
+            kEntryRecords   u32 tid | u32 bytes | bytes 字节的日志记录
+            kEntryCalibrate u64 tsc | u64 realtime 纳秒 | double 每纳秒的 tsc 数
+            kEntryDropped   u32 tid | u64 丢弃的条数（累计值）
+        日志记录        u32 siteId | u32 length（整条记录的字节数，8字节对齐） | u64 tsc | 参数...
+        参数            u8 类型 | 数据（字符串为 u16 长度 + 字节）
+*/
+class BinaryLogger: public noncopyable {
+public:
+    enum ArgType : uint8_t {
+        kArgInt64 = 1,
+        kArgUInt64,
+        kArgDouble,
+        kArgPointer,
+        kArgString,
+    };
+
+    enum EntryType : uint8_t {
+        kEntrySite = 1,
+        kEntryRecords,
+        kEntryCalibrate,
+        kEntryDropped,
+    };
+
+    static const size_t kRecordHeaderSize = 16;
+    static const size_t kRingSize = 1024*1024;         // 每个线程的环形缓冲区大小，必须是 2 的幂
+    static const size_t kMaxStringArg = 256;           // 字符串参数最多保留的字节数
+
+    BinaryLogger(const std::string& basename, off_t rollSize, int drainIntervalMs = 10);
+    ~BinaryLogger();
+
+    // start() 之后 LOG_* 切换到二进制模式；一个进程只应有一个 BinaryLogger
+    void start();
+    void stop();
+    void flush();       // 阻塞，直到各线程目前已经写入的日志都落到文件中
+
+    // 正在运行的 BinaryLogger 执行 flush()，供 Logger::flush（LOG_FATAL）调用
+    static void flushActive();
+
+    static bool isActive() { return active_.load(std::memory_order_relaxed); }
+    static uint32_t registerSite(int level, const char* file, int line, const char* fmt);
+
+    // 读取时间戳计数器，解码时通过校准点换算成真实时间
+    static uint64_t ticks(){
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+    }
+
+    // 热路径：把参数原样拷贝进当前线程的环形缓冲区
+    template <typename... Args>
+    static void write(uint32_t siteId, const Args&... args){
+        size_t length = align(kRecordHeaderSize + argsSize(args...));
+        char* p = reserve(length);
+        if(p == nullptr){
+            return;
+        }
+        uint64_t tsc = ticks();
+        uint32_t len32 = static_cast<uint32_t>(length);
+        memcpy(p, &siteId, 4);
+        memcpy(p + 4, &len32, 4);
+        memcpy(p + 8, &tsc, 8);
+        encodeArgs(p + kRecordHeaderSize, args...);
+        commit();
+    }
+
+private:
+    // 单生产者（所属线程）单消费者（后端线程）的环形缓冲区
+    struct Ring{
+        Ring(int tidArg) : tid(tidArg), head(0), tail(0), dropped(0), retired(false) {}
+
+        const int tid;
+        std::atomic<uint64_t> head;             // 生产者写到的位置
+        std::atomic<uint64_t> tail;             // 消费者读到的位置
+        std::atomic<uint64_t> dropped;          // 写满时丢弃的条数
+        std::atomic_bool retired;               // 所属线程已经退出，读完后可以释放
+        uint64_t droppedReported = 0;           // 只在后端线程中访问
+        char data[kRingSize];
+    };
+
+    static size_t align(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+
+    static char* reserve(size_t length);
+    static void commit();
+    static Ring* createRing();
+
+    struct RingHolder;
+
+    // 参数按类型分成几类，字符数组/字符指针/std::string 按字符串拷贝，其余指针只记录地址
+    template <typename T>
+    struct ArgKind{
+        typedef typename std::decay<T>::type D;
+        static const ArgType value =
+            (std::is_same<D, std::string>::value || std::is_same<D, char*>::value || std::is_same<D, const char*>::value) ? kArgString :
+            std::is_pointer<D>::value ? kArgPointer :
+            std::is_floating_point<D>::value ? kArgDouble :
+            (std::is_signed<D>::value || std::is_enum<D>::value) ? kArgInt64 : kArgUInt64;
+    };
+    typedef std::integral_constant<ArgType, kArgString> StringTag;
+
+    static const char* stringData(const std::string& s) { return s.data(); }
+    static const char* stringData(const char* s) { return s ? s : ""; }
+    static size_t stringSize(const std::string& s) { return std::min(s.size(), kMaxStringArg); }
+    static size_t stringSize(const char* s) { return s ? strnlen(s, kMaxStringArg) : 0; }
+
+    // 计算参数编码后的字节数
+    static size_t argsSize() { return 0; }
+    template <typename T, typename... Rest>
+    static size_t argsSize(const T& arg, const Rest&... rest){
+        return argSize(arg, std::integral_constant<ArgType, ArgKind<T>::value>()) + argsSize(rest...);
+    }
+    template <typename T>
+    static size_t argSize(const T& s, StringTag) { return 3 + stringSize(s); }
+    template <typename T, typename Tag>
+    static size_t argSize(const T&, Tag) { return 9; }
+
+    // 按类型写入参数
+    static void encodeArgs(char*) {}
+    template <typename T, typename... Rest>
+    static void encodeArgs(char* p, const T& arg, const Rest&... rest){
+        encodeArgs(encodeArg(p, arg, std::integral_constant<ArgType, ArgKind<T>::value>()), rest...);
+    }
+    template <typename T>
+    static char* encodeArg(char* p, const T& s, StringTag){
+        size_t len = stringSize(s);
+        uint16_t len16 = static_cast<uint16_t>(len);
+        *p = kArgString;
+        memcpy(p + 1, &len16, 2);
+        memcpy(p + 3, stringData(s), len);
+        return p + 3 + len;
+    }
+    template <typename T>
+    static char* encodeArg(char* p, const T& v, std::integral_constant<ArgType, kArgPointer>){
+        return encodeRaw(p, kArgPointer, reinterpret_cast<uint64_t>(v));
+    }
+    template <typename T>
+    static char* encodeArg(char* p, const T& v, std::integral_constant<ArgType, kArgDouble>){
+        return encodeRaw(p, kArgDouble, static_cast<double>(v));
+    }
+    template <typename T>
+    static char* encodeArg(char* p, const T& v, std::integral_constant<ArgType, kArgInt64>){
+        return encodeRaw(p, kArgInt64, static_cast<int64_t>(v));
+    }
+    template <typename T>
+    static char* encodeArg(char* p, const T& v, std::integral_constant<ArgType, kArgUInt64>){
+        return encodeRaw(p, kArgUInt64, static_cast<uint64_t>(v));
+    }
+    template <typename T>
+    static char* encodeRaw(char* p, ArgType type, T v){
+        *p = type;
+        memcpy(p + 1, &v, 8);
+        return p + 9;
+    }
+
+    struct Site{
+        int level;
+        const char* file;
+        int line;
+        const char* fmt;
+    };
+
+    void threadFunc();
+    void drainRings(LogFile& output);
+    void appendEntry(LogFile& output, const char* data, size_t len);
+    void writeSites(LogFile& output, size_t siteCount);
+    void writeCalibration(LogFile& output);
+    void updateTickRate();
+
+    static std::atomic_bool active_;
+    static std::mutex registryMutex_;                       // 保护 sites_ 和 rings_
+    static std::vector<Site> sites_;
+    static std::vector<Ring*> rings_;                       // 进程退出时不释放，其他线程可能还在写
+    static __thread Ring* t_ring_;                          // 当前线程的环形缓冲区
+    static __thread uint64_t t_pendingHead_;                // reserve 之后、commit 之前的新 head
+
+    const std::string basename_;
+    const off_t rollSize_;
+    const int drainIntervalMs_;
+    std::atomic_bool running_;
+    Thread thread_;
+
+    // 以下只在后端线程中访问
+    size_t sitesWritten_;                   // 当前文件中已经写入定义的调用点个数
+    int rollCount_;                         // 上一次写文件头时 LogFile 的滚动次数
+    uint64_t lastCalibrateNs_;
+    uint64_t baseTicks_;                    // 估计 tsc 频率的基线
+    uint64_t baseNs_;
+    double ticksPerNs_;
+    std::string chunk_;                     // 搬运日志记录的临时缓冲区
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable flushedCond_;
+    uint64_t flushRequested_;
+    uint64_t flushCompleted_;
+};
@@ -1,11 +1,16 @@
 #pragma once
 
 #include "noncopyable.h"
+#include "MemoryBudget.h"
+#include "Timestamp.h"
+#include "AllocTracker.h"
 
 #include <vector>
 #include <iostream>     // size_t
 #include <string>
 #include <algorithm>    // copy
+#include <utility>      // swap
+#include <atomic>
 
 /*
     @code
@@ -17,6 +22,9 @@
     0         <=     readerIndex          writerIndex   <=       size
 
     应用写数据 -> 缓冲区 -> Tcp发送缓冲区 -> 网络发送缓冲区 -> TCP发送
+
+    底层 vector 的容量变化都会记到 MemoryBudget 上，设置了 memoryCounter_ 时同时记到该计数器上（比如所属的连接）
+    initialSize 为 0 时不预先分配内存（包括 kCheapPrepend），第一次写入时才分配，用于大量空闲连接的场景
 */
 class Buffer: public noncopyable {
 public:
@@ -24,15 +32,58 @@ public:
     static const size_t kInitialSize = 1024;
     
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize)
+        : buffer_(initialSize > 0 ? kCheapPrepend + initialSize : 0)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
-    {}
+        , charged_(0)
+        , memoryCounter_(nullptr)
+    {
+        updateCharge();
+    }
+
+    ~Buffer(){
+        MemoryBudget::instance().release(charged_);
+        if(memoryCounter_){
+            memoryCounter_->fetch_sub(charged_, std::memory_order_relaxed);
+        }
+    }
 
     size_t readableBytes() const{ return writerIndex_ - readerIndex_; }
-    size_t writableBytes() const{ return buffer_.size() - writerIndex_; }
+    size_t writableBytes() const{ return buffer_.size() > writerIndex_ ? buffer_.size() - writerIndex_ : 0; }
     size_t prependableBytes() const{ return readerIndex_; }
 
+    size_t internalCapacity() const { return buffer_.capacity(); }
+
+    // 交换底层存储，用于不拷贝地转移数据的所有权
+    void swap(Buffer& rhs){
+        buffer_.swap(rhs.buffer_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+        updateCharge();
+        rhs.updateCharge();
+    }
+
+    // 设置额外的内存计数器，已占用的内存会立即记上
+    void setMemoryCounter(std::atomic<size_t>* counter){
+        if(memoryCounter_){
+            memoryCounter_->fetch_sub(charged_, std::memory_order_relaxed);
+        }
+        memoryCounter_ = counter;
+        if(memoryCounter_){
+            memoryCounter_->fetch_add(charged_, std::memory_order_relaxed);
+        }
+    }
+
+    // 收缩底层存储，只保留可读数据和 reserve 大小的可写空间，把多余的内存还回去
+    void shrink(size_t reserve){
+        std::vector<char> buf(kCheapPrepend + readableBytes() + reserve);
+        std::copy(peek(), peek() + readableBytes(), buf.begin() + kCheapPrepend);
+        writerIndex_ = kCheapPrepend + readableBytes();
+        readerIndex_ = kCheapPrepend;
+        buffer_.swap(buf);
+        updateCharge();
+    }
+
 
     // 返回缓冲区中，可读数据的起始地址
     const char* peek() const{
@@ -55,6 +106,7 @@ public:
 
 
     std::string retriveAsString(size_t len){
+        MUDUO_ALLOC_SITE("Buffer::retriveAsString");
         std::string result(peek(), len);     
         retrive(len);                       // 上面一句把缓冲区中可读的数据，已经读取出来，这里肯定要对缓冲区进行复位操作
         return result;
@@ -92,12 +144,17 @@ public:
         Buffer缓冲区是有大小的！但是从fd上读数据的时候，却不知道tcp数据最终的大小
     */ 
     ssize_t readFd(int fd, int* saveErrno);
+    /*
+        同 readFd，改用 recvmsg 读取，同时取出 SO_TIMESTAMPING / SO_TIMESTAMPNS 给出的内核接收时间。
+        没有收到时间戳时 kernelTime 不变。注意对 TCP 而言，内核给出的是本次读到的最后一个 skb 的到达时间
+    */
+    ssize_t readFdWithTimestamp(int fd, int* saveErrno, Timestamp* kernelTime);
     ssize_t writeFd(int fd, int* saveErrno);                    // 通过fd发送数据
 
 private:
-    // 对迭代器进行取引用、取地址，得到首元素地址
-    char* begin(){ return &*buffer_.begin(); }
-    const char* begin() const{ return &*buffer_.begin(); }
+    // 首元素地址，还没有分配内存时为 nullptr（此时 readableBytes() 为 0，不会被解引用）
+    char* begin(){ return buffer_.data(); }
+    const char* begin() const{ return buffer_.data(); }
 
     // 扩容
     void makeSpace(size_t len){
@@ -108,6 +165,7 @@ private:
         if(writableBytes() + prependableBytes() < len + kCheapPrepend){
             // 如果 可写空间(已经被读过可以覆盖的空间) + 可读空间 < len + kCheapPrepend，则扩容
             buffer_.resize(writerIndex_ + len);
+            updateCharge();
         }else{
             // 将可读数据向前移动
             size_t readable = readableBytes();
@@ -119,8 +177,28 @@ private:
         }
     }
 
+    // 按底层 vector 的实际容量记账，只记录和上一次的差值
+    void updateCharge(){
+        size_t capacity = buffer_.capacity();
+        if(capacity > charged_){
+            MemoryBudget::instance().charge(capacity - charged_);
+            if(memoryCounter_){
+                memoryCounter_->fetch_add(capacity - charged_, std::memory_order_relaxed);
+            }
+        }else if(capacity < charged_){
+            MemoryBudget::instance().release(charged_ - capacity);
+            if(memoryCounter_){
+                memoryCounter_->fetch_sub(charged_ - capacity, std::memory_order_relaxed);
+            }
+        }
+        charged_ = capacity;
+    }
+
     std::vector<char> buffer_;
     size_t readerIndex_;
     size_t writerIndex_;    
+
+    size_t charged_;                            // 已经记到 MemoryBudget 上的字节数
+    std::atomic<size_t>* memoryCounter_;
 };
 
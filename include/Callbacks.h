@@ -15,5 +15,8 @@ using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr&)>;             // 关闭回调函数（用户关闭连接时，执行的函数）
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;     // 消息回调函数（用户接收发送消息时，执行的函数）
 using MessageCallback = std::function<void(const TcpConnectionPtr&, Buffer*, Timestamp)>;   // 读回调函数（用户接收数据时，执行的函数）
+// 带内核接收时间的读回调：receiveTime 为 poll 返回的时间，kernelTime 为内核收到这批数据的时间（SO_TIMESTAMPING）
+using TimestampedMessageCallback = std::function<void(const TcpConnectionPtr&, Buffer*, Timestamp receiveTime, Timestamp kernelTime)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;         // 高水位回调函数（用户接收数据时，执行的函数）
+using MemoryBudgetCallback = std::function<void(const TcpConnectionPtr&)>;      // 内存超预算回调函数（连接的缓冲区增长时超出了 MemoryBudget）
 
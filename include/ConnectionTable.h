@@ -0,0 +1,54 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <vector>
+#include <stdint.h>
+
+
+/*
+    ConnectionTable 类功能梳理：
+        TcpServer 保存所有连接的表，代替以连接名为 key 的 unordered_map<std::string, TcpConnectionPtr>
+        1. 连接放在 slots_ 数组的槽位中，删除后槽位放入 freeSlots_ 复用，增删查都是 O(1)，不需要对字符串做哈希
+        2. 连接 id 是 64 位整数：高 32 位是槽位的代数（generation），低 32 位是槽位下标。
+           槽位每被释放一次代数加一，已经关闭的连接的 id 不会查到复用该槽位的新连接
+        3. 不加锁，只在 baseloop 中访问
+*/
+class ConnectionTable: public noncopyable {
+public:
+    ConnectionTable();
+
+    uint64_t acquire();                                         // 占用一个空槽位，返回新连接的 id，随后用 set 放入连接
+    void set(uint64_t id, const TcpConnectionPtr& conn);
+    TcpConnectionPtr find(uint64_t id) const;                   // id 无效或者已经被删除时返回空指针
+    bool remove(uint64_t id);                                   // 删除并释放槽位，id 无效时返回 false
+
+    size_t size() const { return size_; }
+
+    // 依次访问所有连接，f 的参数为 const TcpConnectionPtr&。遍历过程中不能增删
+    template <typename F>
+    void forEach(F f) const{
+        for(const Slot& slot : slots_){
+            if(slot.conn){
+                f(slot.conn);
+            }
+        }
+    }
+
+    void clear();
+
+private:
+    struct Slot{
+        TcpConnectionPtr conn;
+        uint32_t generation;
+    };
+
+    static uint32_t indexOf(uint64_t id) { return static_cast<uint32_t>(id); }
+    static uint32_t generationOf(uint64_t id) { return static_cast<uint32_t>(id >> 32); }
+    const Slot* lookup(uint64_t id) const;
+
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> freeSlots_;                           // 空闲槽位的下标，后进先出，最近释放的槽位更可能还在缓存中
+    size_t size_;
+};
@@ -10,9 +10,11 @@
 #include "Channel.h"
 #include "Poller.h"
 #include "CurrentThread.h"
+#include "Timestamp.h"
 
 class Channel;
 class Poller;
+class PerfCounters;
 
 /* 
     EventLoop 主要成员变量：
@@ -40,6 +42,52 @@ class Poller;
 */ 
 class EventLoop: public noncopyable{
 public:
+    // 一次耗时较长的回调。fd 为 -1 表示 queueInLoop 投递的任务
+    struct SlowCallback{
+        int64_t micros;
+        int fd;
+        Timestamp when;
+    };
+
+    // loop 的运行状态，供 AdminServer 的 /status 使用。utilization 和 slowest 需要先 enableStats
+    struct Stats{
+        pid_t tid;
+        size_t channels;                        // 注册到 poller 上的 fd 个数（含 wakeupFd_）
+        size_t pendingFunctors;                 // 等待执行的任务数
+        uint64_t iterations;                    // 累计的循环次数
+        double utilization;                     // 统计窗口内处理事件和任务的时间占比（未开启统计时为 0）
+        double windowSeconds;                   // 统计窗口的长度
+        std::vector<SlowCallback> slowest;      // 统计窗口内最慢的几个回调，从慢到快
+    };
+
+    /*
+        心跳：loop 被 LoopWatchdog 监视（enableHeartbeat）后，loop 线程在每个回调开始前写入，
+        LoopWatchdog 在其他线程中读取，据此判断 loop 是否卡在某个回调里。没有被监视的 loop 不写心跳
+        用 seq 做顺序锁（只有 loop 线程写）：写之前 seq 变成奇数，写完变成偶数，读者两次读到相同的偶数才算一致
+        由 shared_ptr 持有，loop 析构后 watchdog 仍可安全读取（phase 为 kExited）
+    */
+    struct Heartbeat{
+        enum Phase { kPolling, kIoCallback, kFunctor, kExited };
+
+        explicit Heartbeat(pid_t tidArg) : tid(tidArg) {}
+
+        void set(int phaseArg, int fdArg, int64_t startMicros){
+            uint32_t s = seq.load(std::memory_order_relaxed);
+            seq.store(s + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            phase.store(phaseArg, std::memory_order_relaxed);
+            fd.store(fdArg, std::memory_order_relaxed);
+            callbackStart.store(startMicros, std::memory_order_relaxed);
+            seq.store(s + 2, std::memory_order_release);
+        }
+
+        const pid_t tid;
+        std::atomic<uint32_t> seq{0};           // 每次 set 加 2，也用来区分不同的回调
+        std::atomic<int> phase{kPolling};
+        std::atomic<int> fd{-1};                // 正在处理的 channel 的 fd，任务为 -1
+        std::atomic<int64_t> callbackStart{0};  // 当前回调的开始时间（微秒）
+    };
+
     // Functor 就是一个类型别名，它代表了能够接受零个参数并且不返回任何值的可调用对象，
     // 比如无参函数、Lambda 表达式、成员函数指针等
     using Functor = std::function<void()>;      
@@ -50,6 +98,7 @@ public:
     void loop();                    // 开启事件循环
     void quit();                    // 退出事件循环
     
+    // 本轮 poll 返回的时间（微秒精度），每轮只取一次。loop 线程中的回调需要“当前时间”时优先用它，不必再调用 Timestamp::now()
     Timestamp pollReturnTime() const { return pollReturnTime_; }
     
     void runInLoop(Functor cb);     // 在当前loop执行cb
@@ -64,9 +113,30 @@ public:
 
     bool isInLoopThread() const{ return threadId_ == CurrentThread::getTid(); };    // loop 对象在创建它的线程中
 
+    /*
+        开启回调耗时统计：每个回调结束时多一次 clock_gettime 和最慢回调列表的维护，默认关闭。
+        可以在任意线程调用，统计窗口从 loop 线程处理到该请求时开始。AdminServer::addStatusRoute 会自动开启
+    */
+    void enableStats();
+    // 返回当前统计窗口（开启统计或上一次 reset 以来）的运行状态。resetWindow 为 true 时开始新的统计窗口。
+    // 必须在loop线程中调用（通过 runInLoop/queueInLoop）
+    Stats stats(bool resetWindow = false);
+    const std::shared_ptr<Heartbeat>& heartbeat() const { return heartbeat_; }
+    // 开始写心跳并返回它，LoopWatchdog::watch 调用。可以在任意线程调用，从下一个回调开始生效
+    const std::shared_ptr<Heartbeat>& enableHeartbeat();
+
+    /*
+        为当前 loop 线程打开 perf_event 计数器，按 poll/io/functors 三个阶段统计（见 PerfCounters）
+        必须在 loop 线程中调用（比如 TcpServer 的 ThreadInitCallback 中，或通过 runInLoop）。不可用时返回 false
+    */
+    bool enablePerfCounters();
+    const PerfCounters* perfCounters() const { return perf_.get(); }
+
 private:
     void handleRead();              // wakeup()中调用
-    void doPendingFunctors();       // 执行回调函数。注意，回调是在vector容器中存放的
+    void doPendingFunctors(bool heartbeat, bool timed);     // 执行回调函数。注意，回调是在vector容器中存放的。heartbeat/timed 表示是否写心跳、是否计时
+    void recordCallback(int fd);    // 记录刚执行完的回调的耗时，开启统计或者写心跳时才调用
+    void resetStatsWindow();
 
 private:
     using ChannelList = std::vector<Channel*>;
@@ -86,6 +156,18 @@ private:
 
     std::vector<Functor> pendingFunctors_;      // 需要执行的回调操作
     std::mutex mutex_;                          // 互斥锁，用于保证上述vector容器的线程安全
+
+    // 运行状态统计，除 statsEnabled_ 外只在loop线程中访问。开启统计或写心跳时，每个回调结束时取一次时间，作为下一个回调的开始时间
+    static const size_t kMaxSlowCallbacks = 5;
+    uint64_t iterations_;
+    int64_t callbackStart_;                     // 当前回调的开始时间（微秒）
+    int64_t busyMicros_;                        // 统计窗口内处理事件和任务的总时间
+    Timestamp statsSince_;                      // 统计窗口的开始时间
+    std::vector<SlowCallback> slowest_;
+    std::atomic_bool statsEnabled_;
+    std::shared_ptr<Heartbeat> heartbeat_;
+    std::atomic_bool heartbeatEnabled_;         // 没有 watchdog 时，每个回调前省掉一次顺序锁写入
+    std::unique_ptr<PerfCounters> perf_;        // 未开启时为空，循环中只多一次判断
 };
 
  
\ No newline at end of file
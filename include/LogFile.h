@@ -0,0 +1,59 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+#include <time.h>
+#include <sys/types.h>      // off_t
+
+
+/*
+    LogFile 类功能梳理：
+        1. 滚动日志文件，只在 AsyncLogger / BinaryLogger 的后端线程中使用，所以不加锁
+        2. 写入的字节数超过 rollSize_，或者跨天时，切换到新的文件
+        3. 文件名：basename.20240101-120000.hostname.pid.log
+        4. 不使用 write(2)：文件按 kMapWindowSize 预分配磁盘空间，映射成 MAP_SHARED 的窗口，append 只是 memcpy，
+           写满一个窗口再扩展文件、映射下一个窗口；每隔 flushInterval_ 秒 msync(MS_ASYNC) 一次
+        5. 进程崩溃时已经 memcpy 进映射区的日志都在页缓存中，由内核写回，不会丢失；
+           只有机器掉电才会丢失最后一次 msync 之后的内容。正常切换/关闭文件时把文件截断到实际写入的长度，
+           崩溃留下的文件末尾是预分配的 0
+*/
+class LogFile: public noncopyable {
+public:
+    LogFile(const std::string& basename, off_t rollSize, int flushInterval = 3, int checkEveryN = 1024);
+    ~LogFile();
+
+    void append(const char* logline, size_t len);
+    void flush();
+    bool rollFile();
+    int rollCount() const { return rollCount_; }     // 已经打开过的文件个数，使用者据此在新文件开头写入文件头
+
+private:
+    static std::string getLogFileName(const std::string& basename, time_t* now);
+
+    void closeFile();
+    bool mapWindow(off_t offset);
+    void dropBytes(size_t len);
+
+    const std::string basename_;
+    const off_t rollSize_;
+    const int flushInterval_;           // 刷盘间隔（秒）
+    const int checkEveryN_;             // 每写入 checkEveryN_ 次，检查一次时间
+
+    int count_;
+    time_t startOfPeriod_;              // 当前文件所属那一天的开始时间
+    time_t lastRoll_;
+    time_t lastFlush_;
+
+    int fd_;
+    char* window_;                      // 当前映射的窗口，映射失败时为 nullptr
+    off_t windowOffset_;                // 窗口在文件中的偏移
+    size_t windowPos_;                  // 窗口内已经写入的字节数
+    size_t syncedPos_;                  // 窗口内已经 msync 过的位置
+    off_t writtenBytes_;
+    int rollCount_;
+    off_t droppedBytes_;                // 没有可写的窗口时丢弃的日志字节数，恢复写入后清零
+
+    static const int kRollPerSeconds_ = 60*60*24;
+    static const size_t kMapWindowSize = 4*1024*1024;   // 必须是页大小的整数倍
+};
@@ -3,70 +3,84 @@
 #include <iostream>
 #include <string>
 #include <sys/time.h>
+#include <atomic>
 
 #include "noncopyable.h"
+#include "BinaryLog.h"
 
-// __VA_ARGS__会被替换为你在宏调用时提供的所有参数
-#define LOG_INFO(logmsgFormat, ...)                         \
-    do {                                                    \
-        Logger &logger = Logger::instance();                \
-        logger.setLogLevel(INFO);                           \
-        char buf[1024] = {0};                               \
-        snprintf(buf, 1024, logmsgFormat, __VA_ARGS__);     \
-        logger.log(buf);                                    \
-    } while (0)
+// 定义日志级别，数值越大越严重
+enum LogLevel {
+    DEBUG,      // 调试信息
+    INFO,       // 普通信息
+    ERROR,      // 错误信息
+    FATAL       // 严重错误
+};
 
-#define LOG_ERROR(logmsgFormat, ...)                        \
-    do {                                                    \
-        Logger &logger = Logger::instance();                \
-        logger.setLogLevel(ERROR);                          \
-        char buf[1024] = {0};                               \
-        snprintf(buf, 1024, logmsgFormat, __VA_ARGS__);     \
-        logger.log(buf);                                    \
-    } while (0)
+// 编译期的最低日志级别，低于该级别的 LOG_* 语句会被编译器整个去掉。可以通过 -DMUDUO_MIN_LOG_LEVEL=n 指定
+#ifndef MUDUO_MIN_LOG_LEVEL
+    #ifdef MUDEBUG
+        #define MUDUO_MIN_LOG_LEVEL 0   // DEBUG
+    #else
+        #define MUDUO_MIN_LOG_LEVEL 1   // INFO
+    #endif
+#endif
 
-#define LOG_FATAL(logmsgFormat, ...)                        \
-    do {                                                    \
-        Logger &logger = Logger::instance();                \
-        logger.setLogLevel(FATAL);                          \
-        char buf[1024] = {0};                               \
-        snprintf(buf, 1024, logmsgFormat, __VA_ARGS__);     \
-        logger.log(buf);                                    \
-        exit(-1);                                           \
+/*
+    关闭的日志只有一次可预测的分支（编译期判断 + 一次 relaxed 的原子读），不做任何格式化
+    BinaryLogger 启动后，每个调用点第一次执行时登记格式串，之后只把参数原样拷贝到线程本地的缓冲区，
+    由离线的 logdecoder 格式化；文本分支仍然参与编译，保留 printf 格式检查
+    __VA_ARGS__会被替换为你在宏调用时提供的所有参数，##__VA_ARGS__ 允许不带参数
+*/
+#define LOG_WITH_LEVEL(level, logmsgFormat, ...)                            \
+    do {                                                                    \
+        if (MUDUO_MIN_LOG_LEVEL <= (level) && Logger::isEnabled(level)) {   \
+            if (BinaryLogger::isActive()) {                                 \
+                static const uint32_t muduoLogSite = BinaryLogger::registerSite(level, __FILE__, __LINE__, logmsgFormat); \
+                BinaryLogger::write(muduoLogSite, ##__VA_ARGS__);           \
+            } else {                                                        \
+                Logger::instance().log(level, logmsgFormat, ##__VA_ARGS__); \
+            }                                                               \
+        }                                                                   \
     } while (0)
 
-#ifdef MUDEBUG
-    #define LOG_DEBUG(logmsgFormat, ...)                        \
-        do {                                                    \
-            Logger &logger = Logger::instance();                \
-            logger.setLogLevel(DEBUG);                          \
-            char buf[1024] = {0};                               \
-            snprintf(buf, 1024, logmsgFormat, __VA_ARGS__);     \
-            logger.log(buf);                                    \
-        } while (0)
-#else
-    #define LOG_DEBUG(logmsgFormat, ...)
-#endif
+#define LOG_DEBUG(logmsgFormat, ...) LOG_WITH_LEVEL(DEBUG, logmsgFormat, ##__VA_ARGS__)
+#define LOG_INFO(logmsgFormat, ...)  LOG_WITH_LEVEL(INFO, logmsgFormat, ##__VA_ARGS__)
+#define LOG_ERROR(logmsgFormat, ...) LOG_WITH_LEVEL(ERROR, logmsgFormat, ##__VA_ARGS__)
 
-// 定义日志级别 INFO ERROR FATAL DEBUG
-enum LogLevel {
-    INFO,       // 普通信息
-    ERROR,      // 错误信息
-    FATAL,      // 严重错误
-    DEBUG       // 调试信息
-};
+// FATAL 不受级别控制，总是以文本输出，flush（包括二进制日志）后退出进程
+#define LOG_FATAL(logmsgFormat, ...)                                        \
+    do {                                                                    \
+        Logger &logger = Logger::instance();                                \
+        logger.log(FATAL, logmsgFormat, ##__VA_ARGS__);                     \
+        logger.flush();                                                     \
+        exit(-1);                                                           \
+    } while (0)
 
 // 输出一个日志类（单例模式）
 class Logger : noncopyable {
 public:
+    // 日志的输出函数，默认写到标准输出（不逐行flush）。AsyncLogger::start 会把输出切换到后端线程
+    using OutputFunc = void (*)(const char* msg, size_t len);
+    using FlushFunc = void (*)();
+
     // 获取日志唯一的实例对象
     static Logger& instance();
-    // 设置日志级别
-    void setLogLevel(int level);
+    // 设置运行时的日志级别，低于该级别的日志不输出，可以在运行中随时调整。初始值等于 MUDUO_MIN_LOG_LEVEL（定义 MUDEBUG 时为 DEBUG）
+    static void setLogLevel(int level){ logLevel_.store(level, std::memory_order_relaxed); }
+    static int logLevel(){ return logLevel_.load(std::memory_order_relaxed); }
+    static bool isEnabled(int level){ return level >= logLevel_.load(std::memory_order_relaxed); }
     // 写日志
-    void log(std::string msg);
+    void log(int level, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+    // 把已经输出的日志刷出去，LOG_FATAL 退出前调用
+    void flush();
+
+    // 设置输出函数，传入 nullptr 恢复默认
+    void setOutput(OutputFunc out);
+    void setFlush(FlushFunc flush);
 
 private:
-    int logLevel_;
-    Logger(){};
+    static std::atomic_int logLevel_;
+    std::atomic<OutputFunc> output_;
+    std::atomic<FlushFunc> flush_;
+    Logger();
 };
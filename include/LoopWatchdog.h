@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+#include "Thread.h"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+#include <signal.h>     // SIGUSR2
+
+
+/*
+    LoopWatchdog 类功能梳理（loop 卡顿检测）：
+        1. 一个单独的线程每隔 checkInterval 读一遍被监视的 loop 的心跳（EventLoop::Heartbeat）
+        2. 某个 loop 的同一个回调（seq 没变）运行超过 threshold，就记录一次卡顿：
+           tid、阶段（I/O 回调还是 queueInLoop 任务）、fd、已经运行的时间，并计入 muduo_loop_stalls_total
+        3. 开启 enableStackCapture 后，向卡住的线程发一个信号，在信号处理函数里用 backtrace 抓取调用栈，
+           由 watchdog 线程符号化后写日志
+        日志都由 watchdog 线程写，卡住的 loop 线程不参与（配合 AsyncLogger 时不会阻塞在磁盘上）
+
+    用法：
+        LoopWatchdog watchdog(100);
+        watchdog.enableStackCapture();
+        for(EventLoop* loop : server.getAllLoops()) watchdog.watch(loop);   // server.start() 之后
+        watchdog.start();
+*/
+class LoopWatchdog: public noncopyable {
+public:
+    explicit LoopWatchdog(int thresholdMs = 100, int checkIntervalMs = 0);     // checkIntervalMs 为 0 时取 threshold 的一半
+    ~LoopWatchdog();
+
+    // 可以在任意线程、任意时刻调用。让 loop 开始写心跳（见 EventLoop::enableHeartbeat），只保存心跳，loop 先析构也没有问题
+    void watch(EventLoop* loop);
+
+    // 用 signo 抓取卡住线程的调用栈，在 start 之前调用。一个进程中只应有一个 watchdog 开启该功能
+    void enableStackCapture(int signo = SIGUSR2);
+
+    void start();
+    void stop();
+
+private:
+    struct Watched{
+        std::shared_ptr<EventLoop::Heartbeat> heartbeat;
+        uint32_t reportedSeq;           // 已经报告过的回调，同一个回调只报告一次
+    };
+
+    void threadFunc();
+    void check(Watched& watched, int64_t nowMicros);
+    void captureStack(pid_t tid);
+
+    static void signalHandler(int signo);
+
+    const int thresholdMs_;
+    const int checkIntervalMs_;
+    int stackSignal_;                   // 0 表示不抓取调用栈
+    std::atomic_bool running_;
+    Thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<Watched> watched_;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <utility>      // pair
+#include <stdint.h>
+#include <stddef.h>     // size_t
+
+
+/*
+    MemoryBudget 类功能梳理：
+        1. 进程内所有 Buffer 的内存记账（单例），Buffer 每次扩容/释放都会更新 used_，全程无锁
+        2. limit_ 为 0 表示不限制；used_ 超过 limit_ 后由 TcpServer 按策略处理（暂停读、踢掉最大的连接、关闭连接）
+        3. used_ 从 limit_ 以上回落到 lowWaterMark 以下时，调用所有登记的 RecoverCallback，用于恢复被暂停读的连接
+           每个 TcpServer 各登记一个，互不覆盖
+*/
+class MemoryBudget: public noncopyable {
+public:
+    using RecoverCallback = std::function<void()>;
+
+    static MemoryBudget& instance();
+
+    void charge(size_t bytes){ used_.fetch_add(bytes, std::memory_order_relaxed); }
+    void release(size_t bytes);
+
+    size_t used() const { return used_.load(std::memory_order_relaxed); }
+    size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+    size_t lowWaterMark() const { return limit() / 4 * 3; }
+
+    // 超出预算。热路径上只有两次 relaxed 读
+    bool exceeded() const {
+        size_t limit = limit_.load(std::memory_order_relaxed);
+        return limit != 0 && used_.load(std::memory_order_relaxed) > limit;
+    }
+
+    // 在启动服务之前设置
+    void setLimit(size_t limit){ limit_.store(limit, std::memory_order_relaxed); }
+    /*
+        登记内存回落时的回调，返回用于注销的 id（不为 0）。可以在任意线程调用
+        removeRecoverCallback 返回后，该回调保证不在执行、也不会再被调用，注销方可以放心析构回调引用的对象
+    */
+    uint64_t addRecoverCallback(const RecoverCallback& cb);
+    void removeRecoverCallback(uint64_t id);
+
+private:
+    MemoryBudget()
+        : used_(0)
+        , limit_(0)
+        , nextCallbackId_(1)
+    {}
+
+    std::atomic<size_t> used_;
+    std::atomic<size_t> limit_;
+
+    std::mutex mutex_;                                          // 保护下面两个成员，回调也在锁内调用
+    std::vector<std::pair<uint64_t, RecoverCallback>> recoverCallbacks_;
+    uint64_t nextCallbackId_;
+};
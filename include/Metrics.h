@@ -0,0 +1,157 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+
+
+/*
+    指标子系统：
+        Counter     只增的计数器
+        Gauge       可增可减的当前值
+        Histogram   固定分桶的直方图
+    Counter、Histogram 按线程分片：每个线程固定写自己的分片（relaxed 原子操作，分片之间按缓存行隔开），
+    采集时把各个分片加起来，所以 I/O 线程之间、I/O 线程和采集线程之间都没有锁，也没有共享缓存行的争用。
+
+    指标注册到 MetricsRegistry 后永不释放（进程退出时其他线程可能还在写），
+    MetricsRegistry::scrapePrometheus() 输出 Prometheus 文本格式，由 AdminServer 的 /metrics 提供。
+*/
+namespace metrics{
+
+static const int kShards = 16;          // 分片数，线程按创建顺序轮流分配
+
+// 当前线程所用的分片下标
+int shardIndex();
+
+
+class Counter: public noncopyable {
+public:
+    void inc(uint64_t n = 1){
+        shards_[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Shard{
+        std::atomic<uint64_t> value{0};
+    };
+    Shard shards_[kShards];
+};
+
+
+// 低频变化的当前值（连接数等），不分片
+class Gauge: public noncopyable {
+public:
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    void sub(int64_t n) { value_.fetch_sub(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+
+/*
+    直方图：bounds 为各个桶的上界（升序），最后还有一个 +Inf 桶
+    每个分片的 sum 只有本线程写，用 CAS 累加 double 没有争用
+*/
+class Histogram: public noncopyable {
+public:
+    explicit Histogram(const std::vector<double>& bounds);
+    ~Histogram();
+
+    void observe(double v);
+
+    const std::vector<double>& bounds() const { return bounds_; }
+    // 各个桶（不累加）的计数，最后一个是 +Inf 桶
+    std::vector<uint64_t> bucketCounts() const;
+    double sum() const;
+    uint64_t count() const;
+
+    // 1, 2, 4, ... 共 n 个桶上界
+    static std::vector<double> exponentialBounds(double start, double factor, int n);
+
+private:
+    struct alignas(64) Shard{
+        std::atomic<double> sum{0.0};
+        std::atomic<uint64_t>* buckets = nullptr;
+    };
+
+    const std::vector<double> bounds_;
+    Shard shards_[kShards];
+};
+
+
+/*
+    指标注册表（单例）。名字相同的指标只创建一次，labels 为 Prometheus 的标签，如 loop="1"
+    注册只在启动阶段或对象创建时发生，用一把锁保护；热路径上只访问返回的引用
+*/
+class MetricsRegistry: public noncopyable {
+public:
+    static MetricsRegistry& instance();
+
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = std::string());
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = std::string());
+    Histogram& histogram(const std::string& name, const std::string& help,
+                         const std::vector<double>& bounds, const std::string& labels = std::string());
+
+    // Prometheus text exposition format 0.0.4
+    std::string scrapePrometheus() const;
+
+private:
+    enum Type { kCounter, kGauge, kHistogram };
+
+    struct Entry{
+        std::string name;
+        std::string help;
+        std::string labels;
+        Type type;
+        void* metric;
+    };
+
+    MetricsRegistry() = default;
+    Entry* find(const std::string& name, const std::string& labels);
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;        // 按注册顺序输出，同名的指标放在一起
+};
+
+
+/*
+    库内部埋点用到的指标，第一次使用时注册
+*/
+struct CoreMetrics{
+    CoreMetrics();
+
+    // Acceptor
+    Counter& connectionsAccepted;
+    Counter& acceptErrors;
+
+    // TcpConnection
+    Counter& connectionsClosed;
+    Gauge& connectionsActive;
+    Counter& bytesRead;
+    Counter& bytesWritten;
+    Counter& writeEagain;               // write 返回 EAGAIN，内核发送缓冲区已满
+    Counter& highWaterMarkHits;
+
+    // EventLoop
+    Counter& loopIterations;
+    Counter& functorsQueued;
+    Counter& wakeups;
+    Histogram& functorQueueDepth;       // 每轮 doPendingFunctors 执行的任务数
+
+    // EPollPoller
+    Counter& epollWaits;
+    Counter& epollCtls;
+    Histogram& eventsPerWait;
+};
+
+CoreMetrics& core();
+
+}   // namespace metrics
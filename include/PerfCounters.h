@@ -0,0 +1,54 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Metrics.h"
+
+#include <string>
+#include <stdint.h>
+
+
+/*
+    PerfCounters 类功能梳理（loop 线程的硬件性能计数器，可选）：
+        1. 用 perf_event_open 为当前线程打开一组计数器：cycles、instructions、cache-misses、context-switches，
+           作为一个 group 打开，一次 read 读出所有计数，各个计数覆盖相同的时间段
+        2. EventLoop 在每轮循环的三个阶段边界各读一次，把增量累加到对应阶段：
+               poll（含 epoll_wait 和循环本身的开销）、io（处理活跃 channel）、functors（doPendingFunctors）
+        3. 结果记到 muduo_loop_perf_events_total{loop="tid",phase="io",event="cycles"}，
+           instructions/cycles 就是各阶段的 IPC，可以和延迟直方图放在一起看
+
+    降级：某个事件打不开（虚拟机没有 PMU、perf_event_paranoid 限制等）就跳过该事件，
+    先尝试包含内核态，被拒绝时只统计用户态；一个都打不开时 valid() 为 false，EventLoop 不启用。
+    每次读取是一次 read 系统调用（约 1 微秒），所以默认关闭，只在需要分析时开启
+*/
+class PerfCounters: public noncopyable {
+public:
+    enum Event { kCycles, kInstructions, kCacheMisses, kContextSwitches, kNumEvents };
+    enum Phase { kPoll, kIo, kFunctors, kNumPhases };
+
+    // 为调用线程打开计数器，必须在 loop 线程中构造。label 用作指标的 loop 标签
+    explicit PerfCounters(const std::string& label);
+    ~PerfCounters();
+
+    bool valid() const { return leaderFd_ >= 0; }
+    bool hasEvent(Event e) const { return fds_[e] >= 0; }
+
+    // 读一次计数，把上次读取以来的增量记到 phase 上
+    void endPhase(Phase phase);
+
+    // 阶段的累计值，只在 loop 线程中调用
+    uint64_t total(Phase phase, Event e) const { return totals_[phase][e]; }
+
+    static const char* eventName(Event e);
+    static const char* phaseName(Phase phase);
+
+private:
+    bool read(uint64_t* values);
+
+    int leaderFd_;
+    int fds_[kNumEvents];
+    int numOpened_;
+    Event order_[kNumEvents];                           // group read 返回的顺序就是打开的顺序
+    uint64_t last_[kNumEvents];
+    uint64_t totals_[kNumPhases][kNumEvents];
+    metrics::Counter* counters_[kNumPhases][kNumEvents];
+};
@@ -26,6 +26,7 @@ public:
     virtual void removeChannel(Channel* channel) = 0;
 
     bool hasChannel(Channel* channel) const;                // 判断参数channel是否在当前Poller的ChannelList中 
+    size_t numChannels() const { return channels_.size(); } // 注册的fd个数，在loop线程中调用
     static Poller* getDefaultPoller(EventLoop *loop);       // 该方法实现不写在Poller.cc文件中！！！ 因为基类中不建议使用派生类对象
 
 protected:
@@ -33,6 +34,8 @@ protected:
     using ChannelMap = std::unordered_map<int, Channel*>;   
     ChannelMap channels_;   // 定义Poller所属的事件循环的 ChannelList
 
+    EventLoop* ownerLoop() const { return owerLoop_; }
+
 private:
     EventLoop *owerLoop_;   // 定义Poller所属的事件循环
 
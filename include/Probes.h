@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+    USDT 静态探针（provider 为 muduo），用 bpftrace / perf 在运行中的进程上挂载：
+        bpftrace -e 'usdt:./lib/libmuduocpp11.so:muduo:conn_read { @bytes[arg1] = sum(arg2); }'
+        perf probe -x ./lib/libmuduocpp11.so sdt_muduo:poll_return
+
+    没有挂载时，每个探针只是一条 nop 指令（参数的位置记录在 ELF 的 .note.stapsdt 段中），运行时没有开销。
+    编译时找到 <sys/sdt.h>（systemtap-sdt-dev）并打开 MUDUO_USDT 选项才会定义 MUDUO_HAVE_SDT，否则探针为空宏，参数不会被求值。
+
+    参数约定：第一个参数总是所属 EventLoop 的地址，作为 loop id
+        poll_entry(loop, timeoutMs, numChannels)        poll_return(loop, numEvents)
+        channel_handle(loop, fd, revents)               loop_wakeup(loop)
+        functors_run(loop, count)                       functors_done(loop, count)
+        conn_read(loop, fd, bytes)                      conn_write(loop, fd, bytes)
+        conn_established(loop, fd)                      conn_destroyed(loop, fd)
+    bytes 为 read/write 的返回值，出错时为 -1
+*/
+#ifdef MUDUO_HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define MUDUO_PROBE1(name, a1)                  DTRACE_PROBE1(muduo, name, a1)
+#define MUDUO_PROBE2(name, a1, a2)              DTRACE_PROBE2(muduo, name, a1, a2)
+#define MUDUO_PROBE3(name, a1, a2, a3)          DTRACE_PROBE3(muduo, name, a1, a2, a3)
+
+#else
+
+#define MUDUO_PROBE1(name, a1)                  do {} while(0)
+#define MUDUO_PROBE2(name, a1, a2)              do {} while(0)
+#define MUDUO_PROBE3(name, a1, a2, a3)          do {} while(0)
+
+#endif
@@ -28,6 +28,8 @@ public:
     void setReuseAddr(bool on);
     void setReuserPort(bool on);
     void setKeepAlive(bool on);
+    bool setZeroCopy(bool on);              // SO_ZEROCOPY，内核不支持时返回false
+    bool setRxTimestamp(bool on);           // 接收方向的内核软件时间戳，优先 SO_TIMESTAMPING，不支持时退回 SO_TIMESTAMPNS
     
 private:
     const int sockfd_;
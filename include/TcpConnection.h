@@ -5,15 +5,33 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "Socket.h"
+#include "Channel.h"
 
 #include <memory>   // enable_shared_from_this
 #include <string>
 #include <atomic>
+#include <deque>
+#include <utility>  // pair
 
 
-class Channel;
 class EventLoop;
-class Socket;
+
+
+/*
+    一个连接用到的全部用户回调。同一个 TcpServer 的连接共享同一份（只读，按指针共享），
+    不再每个连接各拷贝一遍 std::function；单个连接调用 setXxxCallback 时先复制出自己私有的一份再修改
+*/
+struct ConnectionCallbacks{
+    ConnectionCallback connection;
+    MessageCallback message;
+    TimestampedMessageCallback timestampedMessage;
+    WriteCompleteCallback writeComplete;
+    HighWaterMarkCallback highWaterMark;
+    CloseCallback close;
+    MemoryBudgetCallback memoryBudget;
+};
+using ConnectionCallbacksPtr = std::shared_ptr<const ConnectionCallbacks>;
 
 
 /*  TcpConnection类的主要成员：
@@ -24,12 +42,14 @@ class Socket;
         
         loop_               # channel所在的事件循环（subloop）
 
-        callbacks          # TcpServer中注册的各种回调操作
+        callbacks_          # TcpServer中注册的各种回调操作，多个连接共享
 
         inputBuffer_        # 发送缓冲区相关
         outputBuffer_
         highWaterMark_
 
+        zeroCopyPending_    # MSG_ZEROCOPY 发送中、内核尚未通知完成的数据
+
     TcpConnection类功能梳理：
         1. TcpConnection 用来打包成功连接客户端的通信链路。socket_、channel_
         2. TcpServer => Acceptor => TcpConnection => Channel => Poller
@@ -44,33 +64,97 @@ private:
     };
 
 public:
+    /*
+        id          TcpServer 分配的连接 id，见 ConnectionTable
+        namePrefix  同一个 TcpServer 的连接共享的名字前缀（"服务器名-ip:port"），可以为空
+    */
     TcpConnection(EventLoop *loop, 
-                const std::string& nameArg, 
+                uint64_t id,
+                const std::shared_ptr<const std::string>& namePrefix,
                 int sockfd,
                 const InetAddress& localAddr,
                 const InetAddress& peerAddr);
     ~TcpConnection();
 
     EventLoop* getLoop() const { return loop_; }
-    const std::string& getName() const { return name_; }
+    uint64_t getId() const { return id_; }
+    // 连接名 "前缀#下标.代数"，每次调用时才格式化，只应该在输出日志等不频繁的地方使用
+    std::string getName() const;
     const InetAddress& getLocalAddrress() const { return localAddr_; }
     const InetAddress& getPeerAddrress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
 
-    void send(const std::string& buf);              // 发送数据
+    /*
+        发送数据，loop线程中调用时直接尝试write，其他线程中调用时把数据交给loop线程发送：
+            const std::string&、const void*     跨线程时需要拷贝一份
+            std::string&&                       数据被move进loop的任务中，不拷贝
+            Buffer*                             交换底层存储，调用后buf为空
+            shared_ptr<const std::string>       共享数据，只增加引用计数
+    */
+    void send(const std::string& buf);
+    void send(std::string&& buf);
+    void send(const void* data, size_t len);
+    void send(Buffer* buf);
+    void send(const std::shared_ptr<const std::string>& payload);
     void shutdown();                                // 关闭连接
+    void forceClose();                              // 不等待数据发完，直接关闭连接
+    void setTcpNoDelay(bool on);                    // 关闭/开启 Nagle 算法
+
+    // 自动合并：同一轮事件循环中的多次 send 先攒在 outputBuffer_ 中，本轮结束时一次写出。在loop线程中设置
+    void setAutoCork(bool on) { autoCork_ = on; }
+    bool isAutoCork() const { return autoCork_; }
+    void flush();                                   // 立即发送攒下的数据
+
+    void startRead();                               // 恢复/暂停读，即向poller注册/注销 EPOLLIN
+    void stopRead();
+    bool isReading() const { return reading_; }
+    // TcpServer 内存预算使用的暂停/恢复读：只在没有其他暂停原因（读流控）时才真正恢复，不会清掉读流控的状态
+    void pauseReadForBudget();
+    void resumeReadForBudget();
+
+    // 读流控：outputBuffer_ 超过 highWaterMark 时暂停读，降到 lowWaterMark 以下时恢复。在loop线程中设置
+    void setReadFlowControl(size_t highWaterMark, size_t lowWaterMark);
+
+    // 超过 threshold 字节的数据使用 MSG_ZEROCOPY 发送，只对交出所有权的 send（std::string&&、Buffer*、shared_ptr）生效。
+    // 应在连接建立回调中（loop线程）调用
+    void setZeroCopy(bool on, size_t threshold = kDefaultZeroCopyThreshold);
+    bool isZeroCopy() const { return zeroCopy_; }
 
     void setState(StateE state) { state_ = state; }
 
     void connectEstablished();      // 连接建立
     void connectDestroyed();        // 连接销毁
 
-    void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
-    void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
-    void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
-    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb) { highWaterMarkCallback_ = cb; }
-    void setCloseCallback(const CloseCallback& cb){ closeCallback_ = cb; }
+    // 一次设置全部回调，和其他连接共享同一份，TcpServer 创建连接时使用。在 connectEstablished 之前调用
+    void setCallbacks(const ConnectionCallbacksPtr& callbacks);
+
+    void setConnectionCallback(const ConnectionCallback& cb) { mutableCallbacks().connection = cb; }
+    void setMessageCallback(const MessageCallback& cb) { mutableCallbacks().message = cb; }
+    /*
+        设置后开启内核接收时间戳（SO_TIMESTAMPING，不支持时用 SO_TIMESTAMPNS），读事件改为调用该回调，不再调用 MessageCallback
+        kernelTime 是 inputBuffer_ 中最早一批数据的内核到达时间，用来统计 线路 => 回调 的延迟。
+        注意对 TCP，内核给出的是一次 recvmsg 读到的最后一个 skb 的时间，一次读到多个报文段时会略晚于第一个字节的到达时间
+    */
+    void setTimestampedMessageCallback(const TimestampedMessageCallback& cb);
+    void setWriteCompleteCallback(const WriteCompleteCallback& cb) { mutableCallbacks().writeComplete = cb; }
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb) { mutableCallbacks().highWaterMark = cb; }
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark) {
+        mutableCallbacks().highWaterMark = cb; 
+        highWaterMark_ = highWaterMark;
+    }
+    void setHighWaterMark(size_t highWaterMark) { highWaterMark_ = highWaterMark; }
+    void setCloseCallback(const CloseCallback& cb){ mutableCallbacks().close = cb; }
+    void setMemoryBudgetCallback(const MemoryBudgetCallback& cb){ mutableCallbacks().memoryBudget = cb; }
+
+    // 被采样的连接的 trace id（见 Tracer），在 connectEstablished 之前设置，0 表示不追踪
+    void setTraceId(uint64_t traceId) { traceId_ = traceId; }
+    uint64_t getTraceId() const { return traceId_; }
+
+    // inputBuffer_ 和 outputBuffer_ 占用的内存（按容量计算），可以在任意线程读取
+    size_t bufferedMemory() const { return bufferBytes_.load(std::memory_order_relaxed); }
+
+    static const size_t kDefaultZeroCopyThreshold = 64*1024;     // 小数据做页面pin和完成通知的开销比拷贝还大
 
 private:
     // enum StateE{
@@ -83,32 +167,66 @@ private:
     void handleError();
 
     void sendInLoop(const void* data, size_t len);
+    // owner 保证 [data, data + len] 在发送完成前一直有效
+    void sendOwned(const std::shared_ptr<const void>& owner, const char* data, size_t len);
+    void sendOwnedInLoop(const std::shared_ptr<const void>& owner, const char* data, size_t len);
+    bool useZeroCopy(size_t len) const { return zeroCopy_ && len >= zeroCopyThreshold_; }
+    bool handleZeroCopyCompletion();                // 读取错误队列中的零拷贝完成通知
 
     void shutdownInLoop();
+    void flushInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
+    void enableReadInLoop();                        // 只注册/注销 EPOLLIN，不改变暂停原因
+    void disableReadInLoop();
+    void pauseReadForBudgetInLoop();
+    void resumeReadForBudgetInLoop();
+    void checkReadFlowControl();
+    void checkMemoryBudget();
+    void forceCloseInLoop();
+    ConnectionCallbacks& mutableCallbacks();        // 写时复制，返回本连接私有的回调集合
 
     EventLoop* loop_;                               // 这里绝对不是 baseLoop，因为 TcpConnection 都是在 subLoop 中管理的
-    const std::string name_;
+    const uint64_t id_;
+    const std::shared_ptr<const std::string> namePrefix_;
     std::atomic_int state_;
     bool reading_;
 
     // 这里和Acceptor类似 Acceptor => mainLoop       TcpConnection => subLoop
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    // 直接内嵌在连接对象中，省掉两次堆分配。socket_ 声明在前，析构时 channel_ 先于 close(fd)
+    Socket socket_;
+    Channel channel_;
 
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
 
-    ConnectionCallback connectionCallback_;     // TcpServer => TcpConnection => Channel
-    MessageCallback messageCallback_;
-    WriteCompleteCallback writeCompleteCallback_;
-    HighWaterMarkCallback highWaterMarkCallback_;
-    CloseCallback closeCallback_;
+    ConnectionCallbacksPtr callbacks_;              // TcpServer => TcpConnection => Channel
 
     size_t highWaterMark_;
 
-    Buffer inputBuffer_;
+    size_t pauseReadMark_;                          // 读流控水位线，0 表示不开启
+    size_t resumeReadMark_;
+    bool readPausedByFlowControl_;                  // 当前的暂停读是否由流控触发
+    bool readPausedByBudget_;                       // 当前的暂停读是否由内存预算触发，两个原因都解除后才恢复读
+
+    std::atomic<size_t> bufferBytes_;               // 必须声明在两个 Buffer 之前，保证比它们后析构
+    Buffer inputBuffer_;                            // 两个缓冲区都是第一次写入时才分配内存，空闲连接不占缓冲区
     Buffer outputBuffer_;
-    
+
+    bool rxTimestamp_;                              // 是否开启了内核接收时间戳
+    Timestamp firstArrival_;                        // inputBuffer_ 中最早一批数据的内核到达时间，inputBuffer_ 读空后清零
+
+    bool autoCork_;
+    bool corkFlushQueued_;                          // 本轮循环末尾的 flush 任务是否已经放入队列
+
+    // 零拷贝发送时内核直接引用用户内存，数据必须保持有效，直到错误队列通知该序号已完成
+    using ZeroCopyPayload = std::pair<uint32_t, std::shared_ptr<const void>>;
+    std::atomic_bool zeroCopy_;
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopySeq_;                          // 下一次 MSG_ZEROCOPY 调用对应的序号，和内核中的计数保持一致
+    std::unique_ptr<std::deque<ZeroCopyPayload>> zeroCopyPending_;     // 开启零拷贝时才创建（空的 deque 也要分配几百字节）
+
+    uint64_t traceId_;
 };
 
 
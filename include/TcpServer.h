@@ -8,11 +8,14 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"      // 提供给用户
 #include "Buffer.h"
+#include "ConnectionTable.h"
 
 #include <functional>
 #include <string>
 #include <memory>
-#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <atomic>
 
 /*
     TcpServer 成员函数：
@@ -20,7 +23,7 @@
         acceptor_
 
         threadPool_     subloop         -- 对应 subReactor
-        connections_    保存所有的TcpConnection
+        connections_    保存所有的TcpConnection，按连接 id 索引（ConnectionTable）
 
         callbacks       用户设置的各种回调操作
 
@@ -43,38 +46,104 @@ public:
         kReusePort
     };
 
+    enum MemoryBudgetPolicy{    // 连接缓冲区的总内存超出预算时的处理策略
+        kStopReading,           // 暂停超预算时还在增长的连接的读，内存回落到低水位后恢复
+        kShedLargest,           // 关闭占用缓冲区内存最多的连接
+        kCloseConnection        // 关闭超预算时还在增长的连接
+    };
+
     TcpServer(EventLoop* loop, const InetAddress& listenAddr, const std::string& nameArg, Option option = kNoReusePort);
     ~TcpServer();
 
     void setThreadInitCallback(const ThreadInitCallback& cb){ threadInitCallback_ = cb; }
-    void setConnectionCallback(const ConnectionCallback& cb){ connectionCallback_ = cb; }
-    void setMessageCallback(const MessageCallback& cb){ messageCallback_ = cb; }
-    void setWriteCompleteCallback( const WriteCompleteCallback& cb){ writeCompleteCallback_ = cb; }
+    // 修改回调后，之后建立的连接使用新的回调集合，已经建立的连接不受影响
+    void setConnectionCallback(const ConnectionCallback& cb){ connectionCallback_ = cb; callbacks_.reset(); }
+    void setMessageCallback(const MessageCallback& cb){ messageCallback_ = cb; callbacks_.reset(); }
+    // 设置后所有新连接开启内核接收时间戳，读事件调用该回调而不是 MessageCallback，见 TcpConnection::setTimestampedMessageCallback
+    void setTimestampedMessageCallback(const TimestampedMessageCallback& cb){ timestampedMessageCallback_ = cb; callbacks_.reset(); }
+    void setWriteCompleteCallback( const WriteCompleteCallback& cb){ writeCompleteCallback_ = cb; callbacks_.reset(); }
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark){ 
+        highWaterMarkCallback_ = cb; 
+        highWaterMark_ = highWaterMark;
+        callbacks_.reset();
+    }
+
+    /*
+        对所有新连接开启读流控：outputBuffer_ 超过 highWaterMark 时暂停读，降到 lowWaterMark 以下时恢复
+        防止快速的客户端配合慢速的下游，把 inputBuffer_ 和 outputBuffer_ 无限撑大
+    */
+    void setReadFlowControl(size_t highWaterMark, size_t lowWaterMark){
+        pauseReadMark_ = highWaterMark;
+        resumeReadMark_ = lowWaterMark;
+    }
+
+    /*
+        设置所有连接缓冲区的内存预算（进程内共享一个 MemoryBudget），limit 为 0 表示不限制。在 start 之前调用
+        进程内的总占用通过 MemoryBudget::instance().used() 读取，本服务器的占用通过 bufferedMemory() 读取，
+        单个连接的占用通过 TcpConnection::bufferedMemory() 读取
+    */
+    void setMemoryBudget(size_t limit, MemoryBudgetPolicy policy);
+    // 本服务器所有连接的缓冲区占用之和，不包含同一进程中其他 TcpServer 的连接。遍历 connections_，只能在 baseloop 中调用
+    size_t bufferedMemory() const;
+
+    // 连接的概况，供 AdminServer 的 /status 使用
+    struct ConnectionStat{
+        std::string name;
+        std::string peer;
+        size_t bufferedMemory;
+    };
+    // 缓冲区占用内存最多的 n 个连接，从多到少。connections_ 只在 baseloop 中访问，所以必须在 baseloop 中调用
+    std::vector<ConnectionStat> topConnectionsByMemory(size_t n) const;
+    size_t numConnections() const { return connections_.size(); }    // 同样只能在 baseloop 中调用
+    // 按 TcpConnection::getId() 查找连接，O(1)，连接已经关闭时返回空指针。同样只能在 baseloop 中调用
+    TcpConnectionPtr findConnection(uint64_t id) const { return connections_.find(id); }
+
+    EventLoop* getLoop() const { return loop_; }
+    // 所有的subloop（没有设置线程数时只有 baseloop），start 之后不再变化
+    std::vector<EventLoop*> getAllLoops() const { return threadPool_->getAllLoops(); }
 
     void setThreadNum(int numThreads);        // 设置线程数量，即设置subloop的个数
     void start();                             // 开启服务器监听
 
 private: 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
-
     void newConnection(int sockfd, const InetAddress& peerAddr);
     void removeConnection(const TcpConnectionPtr& conn);
     void removeConnectionInLoop(const TcpConnectionPtr& conn);
 
+    void onMemoryBudgetExceeded(const TcpConnectionPtr& conn);     // 在连接所在的subloop中执行
+    void onMemoryBudgetRecovered();                                 // 在归还内存的线程中执行
+    void shedLargestInLoop();
+    const ConnectionCallbacksPtr& connectionCallbacks();            // 所有连接共享的回调集合，在 baseloop 中调用
+    void resumeBudgetPausedInLoop();
+
     EventLoop* loop_;                                               // 用户定义的loop，即 baseloop
     const std::string ipPort_;
     const std::string name_;
+    const std::shared_ptr<const std::string> connNamePrefix_;      // 所有连接共享的名字前缀 "name_-ipPort_"
     std::unique_ptr<Acceptor> acceptor_;                            // listenfd 相关操作。运行在manloop，主要为了监听新连接事件。
     std::shared_ptr<EventLoopThreadPool> threadPool_;               // one loop per thread（注意，threadPool_中不包含baseloop）
 
     ThreadInitCallback threadInitCallback_;                         // loop线程初始化回调函数（用户创建线程时，执行的函数）    
     ConnectionCallback connectionCallback_;                         // 连接回调函数（用户连接时，执行的函数）
     MessageCallback messageCallback_;                               // 消息回调函数（用户接收发送消息时，执行的函数）
+    TimestampedMessageCallback timestampedMessageCallback_;         // 带内核接收时间的消息回调函数
     WriteCompleteCallback writeCompleteCallback_;                   // 消息发送完成回调函数（用户发送消息后，执行的函数）
+    HighWaterMarkCallback highWaterMarkCallback_;                   // 高水位回调函数（outputBuffer_ 超过 highWaterMark_ 时，执行的函数）
+    size_t highWaterMark_;
+    ConnectionCallbacksPtr callbacks_;                              // 由上面的回调组装，回调修改后置空，下一个连接到来时重新组装
+
+    size_t pauseReadMark_;                                          // 读流控水位线，0 表示不开启
+    size_t resumeReadMark_;
 
     std::atomic_int started_ ; 
 
-    int nextConnId_;
-    ConnectionMap connections_;                                     // 保存所有的连接
+    bool budgetEnabled_;
+    uint64_t budgetSubscription_;                                   // 在 MemoryBudget 上登记的回落回调 id，0 表示没有登记
+    MemoryBudgetPolicy budgetPolicy_;
+    std::atomic_bool shedQueued_;                                   // 避免重复投递 shedLargestInLoop
+    std::mutex budgetMutex_;                                        // 保护 budgetPaused_，超预算回调在各个subloop中执行
+    std::vector<std::weak_ptr<TcpConnection>> budgetPaused_;        // 因为内存预算被暂停读的连接
+
+    ConnectionTable connections_;                                   // 保存所有的连接
 };
 
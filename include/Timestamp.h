@@ -2,18 +2,46 @@
 
 #include <iostream>
 #include <string>
+#include <stdint.h>
 
 /*
-    时间类
+    时间类，精度为微秒
+        now() 通过 vDSO 的 clock_gettime(CLOCK_REALTIME) 获取时间，不陷入内核
+        toString / formatTo 使用每个线程缓存的日期前缀：同一秒内只拷贝缓存，同一分钟内只改写秒数，
+        跨分钟时才调用一次 localtime_r，避免每行日志都进入 glibc 的时区锁
 */
 class Timestamp{
 public:
     Timestamp();
     explicit Timestamp(int64_t microSecondsSinceEpoch);     // 使用 explicit 限制编译器执行隐式对象转换
     static Timestamp now();
-    std::string toString() const;       // 常量成员函数
+    static Timestamp invalid() { return Timestamp(); }
+
+    std::string toString() const;       // 常量成员函数。2024/01/01 12:00:00
+    std::string toFormattedString(bool showMicroseconds = true) const;  // 2024/01/01 12:00:00.123456
+    // 格式化到调用者的缓冲区，返回写入的字节数（不含结尾的 '\0'），供 Logger 在栈上拼接日志行
+    size_t formatTo(char* buf, size_t len, bool showMicroseconds = true) const;
+
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    time_t secondsSinceEpoch() const { return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond); }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
 
 private:
     int64_t microSecondsSinceEpoch_;
 };
 
+inline bool operator<(Timestamp lhs, Timestamp rhs){
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs){
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// 两个时间点相差的秒数
+inline double timeDifference(Timestamp high, Timestamp low){
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
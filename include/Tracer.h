@@ -0,0 +1,82 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <functional>
+#include <string>
+#include <stdint.h>
+
+
+/*
+    Tracer 请求链路追踪（Chrome trace event 格式，可以直接用 Perfetto / chrome://tracing 打开）：
+        1. 采样以连接为单位：Acceptor 每接受 N 个连接选中一个，分配一个 trace id，
+           TcpConnection 保存该 id，之后该连接上的 handleRead、用户回调、sendInLoop、handleWrite 都会记录 span
+        2. span 写入当前线程的环形缓冲区（只有本线程写，没有锁），写满后覆盖最旧的事件
+        3. 跨线程的跳转（newConnection => subloop 的 connectEstablished，其他线程 send => sendInLoop）用 hop 包装任务，
+           记录一对 flow 事件，在 Perfetto 中显示为箭头，箭头的长度就是在 pendingFunctors_ 中排队的时间
+        4. dumpChromeJson() 在任意线程中导出所有线程的环形缓冲区，AdminServer 的 /trace 提供该功能
+
+    未采样的连接 trace id 为 0，TraceSpan 只多一次分支判断；采样率为 0（默认）时完全关闭
+*/
+class Tracer: public noncopyable {
+public:
+    using Functor = std::function<void()>;
+
+    // 每 oneInN 个连接采样一个，0 表示关闭
+    static void setSampleRate(int oneInN);
+    static int sampleRate();
+
+    // 采样决策：选中时返回新的 trace id，否则返回 0
+    static uint64_t sample();
+    // 当前线程最内层 span 所属的 trace id，没有时为 0
+    static uint64_t currentId();
+
+    /*
+        包装一个要投递到其他 loop 的任务：在当前线程记录 flow 起点，
+        任务执行时在目标线程中打开名为 name 的 span 并记录 flow 终点。traceId 为 0 时原样返回 cb
+    */
+    static Functor hop(const char* name, uint64_t traceId, Functor cb);
+
+    // 导出所有线程的事件，Chrome trace event JSON 格式
+    static std::string dumpChromeJson();
+
+    static int64_t nowNanos();
+    static void recordSpan(const char* name, uint64_t traceId, int64_t startNs, int64_t endNs);
+
+private:
+    friend class TraceSpan;
+    static uint64_t exchangeCurrentId(uint64_t traceId);
+};
+
+
+/*
+    RAII 的 span：构造时记下开始时间，析构时写入当前线程的环形缓冲区。name 必须是字符串常量
+    span 内部 Tracer::currentId() 返回 traceId，所以嵌套的调用（比如 newConnection）不需要额外传参
+*/
+class TraceSpan: public noncopyable {
+public:
+    TraceSpan(const char* name, uint64_t traceId)
+        : name_(name)
+        , traceId_(traceId)
+        , startNs_(0)
+        , prevId_(0)
+    {
+        if(__builtin_expect(traceId_ != 0, 0)){
+            startNs_ = Tracer::nowNanos();
+            prevId_ = Tracer::exchangeCurrentId(traceId_);
+        }
+    }
+
+    ~TraceSpan(){
+        if(__builtin_expect(traceId_ != 0, 0)){
+            Tracer::recordSpan(name_, traceId_, startNs_, Tracer::nowNanos());
+            Tracer::exchangeCurrentId(prevId_);
+        }
+    }
+
+private:
+    const char* name_;
+    const uint64_t traceId_;
+    int64_t startNs_;
+    uint64_t prevId_;
+};
@@ -2,11 +2,15 @@
 
 #include "Logger.h"
 #include "InetAddress.h"
+#include "Metrics.h"
+#include "Tracer.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <error.h>
 #include <unistd.h>
+#include <string.h>
+#include <netinet/in.h>
 
 
 // 创建非阻塞的 socket
@@ -25,10 +29,21 @@ Acceptor::Acceptor(EventLoop* loop, const InetAddress& listenAddr, bool reusepor
     , acceptSocket_(createNonblocking())            // 创建 socket
     , acceptChannel_(loop, acceptSocket_.getFd())   // channel为什么要依赖loop？因为channel需要向poller注册事件，这一操作是通过loop（包括channel、poller）来完成的
     , listenning_(false)
+    , localAddr_(listenAddr)
+    , fixedLocalAddr_(false)
 {
     acceptSocket_.setReuseAddr(true);
     acceptSocket_.setReuserPort(true);
     acceptSocket_.bindAddress(listenAddr);          // 绑定 socket
+
+    // 取绑定后的实际地址，只在这里调用一次 getsockname，之后新连接直接复用
+    sockaddr_in local;
+    memset(&local, 0, sizeof local);
+    socklen_t addrlen = sizeof local;
+    if(::getsockname(acceptSocket_.getFd(), (sockaddr*)&local, &addrlen) == 0){
+        localAddr_.setSockAddr(local);
+        fixedLocalAddr_ = local.sin_addr.s_addr != htonl(INADDR_ANY);
+    }
     /*
         TcpServer::start() 方法调用 Acceptor.listen() 方法来监听 socket  
         当有新用户连接时，acceptChannel_ 会执行现在注册的回调（注意，该回调会在subloop中执行）
@@ -58,15 +73,18 @@ void Acceptor::listen(){
     2. newConnectionCallback_ 函数是 TcpServer 进行注册的绑定回调函数
 */ 
 void Acceptor::handleRead(){
+    TraceSpan span("Acceptor::handleRead", Tracer::sample());     // 以连接为单位采样，newConnection 通过 Tracer::currentId() 拿到 trace id
     InetAddress peerAddr;   // 客户端地址
     int connfd = acceptSocket_.accept(&peerAddr);
     if(connfd >= 0){
+        metrics::core().connectionsAccepted.inc();
         if(newConnectionCallback_){
             newConnectionCallback_(connfd, peerAddr);   // 调用回调函数（TcpServer中注册），轮询找到subloop，唤醒subloop，分发当前新客户端的channel
         }else{
             ::close(connfd);
         }
     }else{
+        metrics::core().acceptErrors.inc();
         LOG_ERROR("Acceptor::handleRead:%d \n", errno);
         if(errno == EMFILE){
             LOG_ERROR("sockfd reached limit:%d \n", errno);
@@ -0,0 +1,249 @@
+#include "AdminServer.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>     // atoi
+#include <vector>
+
+
+AdminServer::AdminServer(EventLoop* loop, const InetAddress& listenAddr, const std::string& name)
+    : server_(loop, listenAddr, name)
+{
+    server_.setConnectionCallback(
+        std::bind(&AdminServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(
+        std::bind(&AdminServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+
+    addRoute("/metrics", [](const std::string&, const Responder& respond){
+        respond("text/plain; version=0.0.4", metrics::MetricsRegistry::instance().scrapePrometheus());
+    });
+    // /trace 导出请求链路追踪；/trace?rate=N 设置采样率（每 N 个连接采样一个，0 关闭）
+    addRoute("/trace", [](const std::string& query, const Responder& respond){
+        if(query.compare(0, 5, "rate=") == 0){
+            Tracer::setSampleRate(atoi(query.c_str() + 5));
+            respond("text/plain", "sample rate set to 1/" + std::to_string(Tracer::sampleRate()) + "\n");
+        }else{
+            respond("application/json", Tracer::dumpChromeJson());
+        }
+    });
+    addRoute("/", [this](const std::string&, const Responder& respond){
+        std::string body;
+        for(const auto& route : routes_){
+            body += route.first + "\n";
+        }
+        respond("text/plain", body);
+    });
+}
+
+
+void AdminServer::addRoute(const std::string& path, const Handler& handler){
+    routes_[path] = handler;
+}
+
+
+void AdminServer::start(){
+    server_.start();
+}
+
+
+namespace {
+
+// JSON 字符串转义。这里只输出少量固定结构的 JSON，手写比引入 json 库更轻
+std::string jsonString(const std::string& s){
+    std::string out("\"");
+    for(char c : s){
+        switch(c){
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if(static_cast<unsigned char>(c) < 0x20){
+                char buf[8];
+                snprintf(buf, sizeof buf, "\\u%04x", c);
+                out += buf;
+            }else{
+                out += c;
+            }
+        }
+    }
+    out += '"';
+    return out;
+}
+
+// 一次 /status 请求的汇总状态，由最后一个完成的采集任务输出
+struct StatusCollection{
+    StatusCollection(size_t numLoops, const AdminServer::Responder& respondArg)
+        : loops(numLoops)
+        , remaining(static_cast<int>(numLoops) + 1)
+        , respond(respondArg)
+    {}
+
+    void done(){
+        if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            respond("application/json", toJson());
+        }
+    }
+
+    std::string toJson() const;
+
+    std::vector<EventLoop::Stats> loops;                    // 每个元素只被对应的 loop 写一次
+    std::vector<TcpServer::ConnectionStat> connections;
+    size_t totalConnections = 0;
+    std::atomic_int remaining;
+    AdminServer::Responder respond;
+};
+
+std::string StatusCollection::toJson() const{
+    char buf[256];
+    std::string out("{\"loops\":[");
+    for(size_t i = 0; i < loops.size(); ++i){
+        const EventLoop::Stats& s = loops[i];
+        snprintf(buf, sizeof buf,
+                 "%s{\"tid\":%d,\"fds\":%lu,\"pendingFunctors\":%lu,\"iterations\":%lu,"
+                 "\"utilization\":%.4f,\"windowSeconds\":%.3f,\"slowestCallbacks\":[",
+                 i == 0 ? "" : ",", s.tid, s.channels, s.pendingFunctors, s.iterations,
+                 s.utilization, s.windowSeconds);
+        out += buf;
+        for(size_t j = 0; j < s.slowest.size(); ++j){
+            const EventLoop::SlowCallback& cb = s.slowest[j];
+            snprintf(buf, sizeof buf, "%s{\"micros\":%ld,\"fd\":%d,\"kind\":\"%s\",\"at\":",
+                     j == 0 ? "" : ",", cb.micros, cb.fd, cb.fd < 0 ? "functor" : "io");
+            out += buf;
+            out += jsonString(cb.when.toFormattedString());
+            out += '}';
+        }
+        out += "]}";
+    }
+
+    snprintf(buf, sizeof buf, "],\"totalConnections\":%lu,\"topConnectionsByMemory\":[", totalConnections);
+    out += buf;
+    for(size_t i = 0; i < connections.size(); ++i){
+        const TcpServer::ConnectionStat& c = connections[i];
+        out += i == 0 ? "{\"name\":" : ",{\"name\":";
+        out += jsonString(c.name);
+        out += ",\"peer\":";
+        out += jsonString(c.peer);
+        snprintf(buf, sizeof buf, ",\"bufferedBytes\":%lu}", c.bufferedMemory);
+        out += buf;
+    }
+    out += "]}\n";
+    return out;
+}
+
+}   // namespace
+
+
+/*
+其他解释：
+    1. 回调耗时统计默认关闭，这里为 server 的 loop 开启；注册时 server 还没有 start 的话，在第一次请求时开启
+    2. 读取不清空统计窗口，/status?reset=1 才开始新的窗口，多个采集方互不影响
+*/
+void AdminServer::addStatusRoute(TcpServer* server, size_t topConnections){
+    for(EventLoop* loop : server->getAllLoops()){
+        loop->enableStats();
+    }
+    addRoute("/status", [server, topConnections](const std::string& query, const Responder& respond){
+        std::vector<EventLoop*> loops = server->getAllLoops();
+        std::shared_ptr<StatusCollection> collection = std::make_shared<StatusCollection>(loops.size(), respond);
+        bool reset = query.find("reset=1") != std::string::npos;
+
+        for(size_t i = 0; i < loops.size(); ++i){
+            EventLoop* loop = loops[i];
+            loop->enableStats();
+            loop->queueInLoop([collection, loop, i, reset](){
+                collection->loops[i] = loop->stats(reset);
+                collection->done();
+            });
+        }
+        server->getLoop()->queueInLoop([collection, server, topConnections](){
+            collection->connections = server->topConnectionsByMemory(topConnections);
+            collection->totalConnections = server->numConnections();
+            collection->done();
+        });
+    });
+}
+
+
+void AdminServer::onConnection(const TcpConnectionPtr& conn){
+    (void)conn;
+}
+
+
+/*
+函数功能：
+    收齐请求头后解析请求行 "GET /path?query HTTP/1.x"，交给对应的处理函数
+其他解释：
+    1. 请求体一律忽略；请求头超过 kMaxRequestSize 时回复 400
+    2. Responder 只生效一次，回复在连接所在的 loop 中发送，发送完后关闭连接
+*/
+void AdminServer::onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp){
+    static const char kHeaderEnd[] = "\r\n\r\n";
+    const char* begin = buf->peek();
+    const char* end = begin + buf->readableBytes();
+    const char* headerEnd = std::search(begin, end, kHeaderEnd, kHeaderEnd + 4);
+    if(headerEnd == end){
+        if(buf->readableBytes() > kMaxRequestSize){
+            buf->retriveAll();
+            reply(conn, "400 Bad Request", "text/plain", "request too large\n");
+        }
+        return;
+    }
+
+    std::string header(begin, headerEnd);
+    buf->retriveAll();
+
+    std::string requestLine = header.substr(0, header.find("\r\n"));
+    size_t sp1 = requestLine.find(' ');
+    size_t sp2 = sp1 == std::string::npos ? std::string::npos : requestLine.find(' ', sp1 + 1);
+    if(sp2 == std::string::npos){
+        reply(conn, "400 Bad Request", "text/plain", "bad request line\n");
+        return;
+    }
+    std::string method = requestLine.substr(0, sp1);
+    std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    if(method != "GET"){
+        reply(conn, "405 Method Not Allowed", "text/plain", "only GET is supported\n");
+        return;
+    }
+
+    size_t question = target.find('?');
+    std::string path = target.substr(0, question);
+    std::string query = question == std::string::npos ? std::string() : target.substr(question + 1);
+
+    auto it = routes_.find(path);
+    if(it == routes_.end()){
+        reply(conn, "404 Not Found", "text/plain", "no such route: " + path + "\n");
+        return;
+    }
+
+    std::shared_ptr<std::atomic_bool> replied = std::make_shared<std::atomic_bool>(false);
+    it->second(query, [conn, replied](const std::string& contentType, const std::string& body){
+        if(!replied->exchange(true)){
+            reply(conn, "200 OK", contentType, body);
+        }
+    });
+}
+
+
+void AdminServer::reply(const TcpConnectionPtr& conn, const char* status,
+                        const std::string& contentType, const std::string& body){
+    char head[256];
+    snprintf(head, sizeof head,
+             "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+             status, contentType.c_str(), body.size());
+    std::string response(head);
+    response += body;
+
+    // 可能在其他线程中回复，统一放到连接所在的 loop 中发送并关闭
+    conn->getLoop()->runInLoop([conn, response]() mutable {
+        conn->send(std::move(response));
+        conn->shutdown();
+    });
+}
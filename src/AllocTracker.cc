@@ -0,0 +1,282 @@
+#include "AllocTracker.h"
+#include "CurrentThread.h"
+
+#include <atomic>
+#include <new>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdio.h>
+#include <malloc.h>         // malloc_usable_size
+
+
+/*
+    每个线程一个 ThreadState，第一次分配时用 malloc 创建（不能用 new，否则递归），放进固定大小的全局表，永不释放。
+    线程数超过 kMaxThreads 时共用 g_overflow，计数都是原子变量，共用也不会算错，只是有争用
+*/
+namespace {
+    const int kMaxThreads = 1024;
+    const int kMaxSites = 32;           // 每个线程最多区分的站点数，超出的计入最后一个
+
+    struct SiteSlot{
+        std::atomic<const char*> site;
+        std::atomic<uint64_t> allocs;
+        std::atomic<uint64_t> bytes;
+    };
+
+    struct ThreadState{
+        int tid;
+        const char* currentSite;        // 只有本线程访问
+        std::atomic<uint64_t> allocs;
+        std::atomic<uint64_t> frees;
+        std::atomic<uint64_t> bytes;
+        std::atomic<int> numSites;
+        SiteSlot sites[kMaxSites];
+    };
+
+    ThreadState* g_states[kMaxThreads];
+    std::atomic<int> g_numStates(0);
+    ThreadState g_overflow;
+
+    __thread ThreadState* t_state = nullptr;
+
+    ThreadState* threadState(){
+        if(__builtin_expect(t_state == nullptr, 0)){
+            int index = g_numStates.load(std::memory_order_relaxed);
+            if(index < kMaxThreads){
+                void* p = ::calloc(1, sizeof(ThreadState));
+                if(p != nullptr){
+                    t_state = static_cast<ThreadState*>(p);
+                    t_state->tid = CurrentThread::getTid();
+                    index = g_numStates.fetch_add(1, std::memory_order_relaxed);
+                    if(index < kMaxThreads){
+                        __atomic_store_n(&g_states[index], t_state, __ATOMIC_RELEASE);
+                        return t_state;
+                    }
+                }
+            }
+            t_state = &g_overflow;
+        }
+        return t_state;
+    }
+
+#ifdef MUDUO_ALLOC_TRACKER
+    // 以下两个只在计数的 operator new/delete 中使用
+    void add(std::atomic<uint64_t>& counter, uint64_t n){
+        // 单写者，load + store 比 fetch_add 少一个 lock 前缀
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    SiteSlot& siteSlot(ThreadState* state, const char* site){
+        int n = state->numSites.load(std::memory_order_relaxed);
+        for(int i = 0; i < n; ++i){
+            if(state->sites[i].site.load(std::memory_order_relaxed) == site){
+                return state->sites[i];
+            }
+        }
+        if(n == kMaxSites || state == &g_overflow){
+            return state->sites[kMaxSites - 1];
+        }
+        state->sites[n].site.store(site, std::memory_order_relaxed);
+        state->numSites.store(n + 1, std::memory_order_release);
+        return state->sites[n];
+    }
+#endif
+
+    // 遍历已登记的线程（包括 g_overflow）
+    template <typename F>
+    void forEachState(F f){
+        int n = std::min(g_numStates.load(std::memory_order_acquire), kMaxThreads);
+        for(int i = 0; i < n; ++i){
+            ThreadState* state = __atomic_load_n(&g_states[i], __ATOMIC_ACQUIRE);
+            if(state != nullptr){
+                f(state);
+            }
+        }
+        f(&g_overflow);
+    }
+
+    AllocTracker::Counts countsOf(const ThreadState* state){
+        AllocTracker::Counts c;
+        c.allocs = state->allocs.load(std::memory_order_relaxed);
+        c.frees = state->frees.load(std::memory_order_relaxed);
+        c.bytes = state->bytes.load(std::memory_order_relaxed);
+        return c;
+    }
+
+    const char* siteName(const char* site){
+        return site != nullptr ? site : "(unattributed)";
+    }
+}
+
+
+#ifdef MUDUO_ALLOC_TRACKER
+
+namespace {
+    void onAlloc(void* p){
+        ThreadState* state = threadState();
+        uint64_t size = ::malloc_usable_size(p);
+        if(state == &g_overflow){
+            state->allocs.fetch_add(1, std::memory_order_relaxed);
+            state->bytes.fetch_add(size, std::memory_order_relaxed);
+            return;
+        }
+        add(state->allocs, 1);
+        add(state->bytes, size);
+        SiteSlot& slot = siteSlot(state, state->currentSite);
+        add(slot.allocs, 1);
+        add(slot.bytes, size);
+    }
+
+    void onFree(){
+        ThreadState* state = threadState();
+        if(state == &g_overflow){
+            state->frees.fetch_add(1, std::memory_order_relaxed);
+        }else{
+            add(state->frees, 1);
+        }
+    }
+
+    void* trackedAlloc(size_t n){
+        void* p = ::malloc(n != 0 ? n : 1);
+        if(p != nullptr){
+            onAlloc(p);
+        }
+        return p;
+    }
+
+    void trackedFree(void* p){
+        if(p != nullptr){
+            onFree();
+            ::free(p);
+        }
+    }
+}
+
+
+// 替换全局的 operator new/delete（C++11 的 8 个可替换版本）
+void* operator new(size_t n){
+    void* p = trackedAlloc(n);
+    if(p == nullptr){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t n){
+    void* p = trackedAlloc(n);
+    if(p == nullptr){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return trackedAlloc(n); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return trackedAlloc(n); }
+void operator delete(void* p) noexcept { trackedFree(p); }
+void operator delete[](void* p) noexcept { trackedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { trackedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { trackedFree(p); }
+
+#endif  // MUDUO_ALLOC_TRACKER
+
+
+AllocTracker::Counts AllocTracker::Counts::operator-(const Counts& rhs) const{
+    Counts c;
+    c.allocs = allocs - rhs.allocs;
+    c.frees = frees - rhs.frees;
+    c.bytes = bytes - rhs.bytes;
+    return c;
+}
+
+
+bool AllocTracker::compiledIn(){
+#ifdef MUDUO_ALLOC_TRACKER
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+AllocTracker::Counts AllocTracker::threadCounts(){
+    return countsOf(threadState());
+}
+
+
+AllocTracker::Counts AllocTracker::totalCounts(){
+    Counts total;
+    forEachState([&total](const ThreadState* state){
+        Counts c = countsOf(state);
+        total.allocs += c.allocs;
+        total.frees += c.frees;
+        total.bytes += c.bytes;
+    });
+    return total;
+}
+
+
+std::vector<std::pair<std::string, AllocTracker::Counts>> AllocTracker::siteCounts(){
+    std::vector<std::pair<std::string, Counts>> sites;
+    forEachState([&sites](const ThreadState* state){
+        int n = state->numSites.load(std::memory_order_acquire);
+        for(int i = 0; i < n; ++i){
+            const SiteSlot& slot = state->sites[i];
+            std::string name(siteName(slot.site.load(std::memory_order_relaxed)));
+            auto it = std::find_if(sites.begin(), sites.end(),
+                [&name](const std::pair<std::string, Counts>& item){ return item.first == name; });
+            if(it == sites.end()){
+                sites.push_back(std::make_pair(name, Counts()));
+                it = sites.end() - 1;
+            }
+            it->second.allocs += slot.allocs.load(std::memory_order_relaxed);
+            it->second.bytes += slot.bytes.load(std::memory_order_relaxed);
+        }
+    });
+    std::sort(sites.begin(), sites.end(),
+        [](const std::pair<std::string, Counts>& a, const std::pair<std::string, Counts>& b){
+            return a.second.allocs > b.second.allocs;
+        });
+    return sites;
+}
+
+
+std::string AllocTracker::report(){
+    if(!compiledIn()){
+        return "alloc tracker not compiled in (MUDUO_ALLOC_TRACKER=OFF)\n";
+    }
+
+    std::string out;
+    char buf[256];
+    forEachState([&out, &buf](const ThreadState* state){
+        Counts c = countsOf(state);
+        if(c.allocs == 0 && c.frees == 0){
+            return;
+        }
+        if(state == &g_overflow){
+            snprintf(buf, sizeof buf, "threads(overflow) allocs=%lu frees=%lu bytes=%lu\n", c.allocs, c.frees, c.bytes);
+        }else{
+            snprintf(buf, sizeof buf, "thread %d allocs=%lu frees=%lu bytes=%lu\n", state->tid, c.allocs, c.frees, c.bytes);
+        }
+        out += buf;
+
+        int n = state->numSites.load(std::memory_order_acquire);
+        for(int i = 0; i < n; ++i){
+            const SiteSlot& slot = state->sites[i];
+            snprintf(buf, sizeof buf, "    %-40s allocs=%lu bytes=%lu\n",
+                     siteName(slot.site.load(std::memory_order_relaxed)),
+                     slot.allocs.load(std::memory_order_relaxed), slot.bytes.load(std::memory_order_relaxed));
+            out += buf;
+        }
+    });
+    return out;
+}
+
+
+const char* AllocTracker::exchangeSite(const char* site){
+    ThreadState* state = threadState();
+    const char* prev = state->currentSite;
+    if(state != &g_overflow){
+        state->currentSite = site;
+    }
+    return prev;
+}
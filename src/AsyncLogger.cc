@@ -0,0 +1,187 @@
+#include "AsyncLogger.h"
+#include "LogFile.h"
+#include "Logger.h"
+#include "Timestamp.h"
+
+#include <chrono>
+#include <stdio.h>
+
+
+// start() 之后接管 Logger 输出的对象
+static std::atomic<AsyncLogger*> g_asyncLogger(nullptr);
+
+
+AsyncLogger::AsyncLogger(const std::string& basename, off_t rollSize, int flushInterval)
+    : flushInterval_(flushInterval)
+    , running_(false)
+    , basename_(basename)
+    , rollSize_(rollSize)
+    , thread_(std::bind(&AsyncLogger::threadFunc, this), "AsyncLogger")
+    , currentBuffer_(new LogBuffer)
+    , nextBuffer_(new LogBuffer)
+    , flushRequested_(0)
+    , flushCompleted_(0)
+{
+    buffers_.reserve(16);
+}
+
+
+AsyncLogger::~AsyncLogger(){
+    if(running_){
+        stop();
+    }
+}
+
+
+// 启动后端线程，并把 Logger 的输出切换到当前对象
+void AsyncLogger::start(){
+    running_ = true;
+    thread_.start();
+
+    g_asyncLogger = this;
+    Logger::instance().setOutput(&AsyncLogger::output);
+    Logger::instance().setFlush(&AsyncLogger::flushOutput);
+}
+
+
+// Logger 恢复到默认的标准输出，再把剩余的日志写完，退出后端线程
+void AsyncLogger::stop(){
+    Logger::instance().setOutput(nullptr);
+    Logger::instance().setFlush(nullptr);
+    g_asyncLogger = nullptr;
+
+    running_ = false;
+    cond_.notify_one();
+    thread_.join();
+}
+
+
+/*
+函数功能：
+    前端写日志，在锁内只做一次 memcpy
+其他解释：
+    currentBuffer_ 写满后放入 buffers_，优先换上预留的 nextBuffer_，
+    只有后端来不及写、两块都用完时才会临时分配新的缓冲区
+*/
+void AsyncLogger::append(const char* logline, size_t len){
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(currentBuffer_->avail() > len){
+        currentBuffer_->append(logline, len);
+    }else{
+        buffers_.push_back(std::move(currentBuffer_));
+
+        if(nextBuffer_){
+            currentBuffer_ = std::move(nextBuffer_);
+        }else{
+            currentBuffer_.reset(new LogBuffer);
+        }
+        currentBuffer_->append(logline, len);
+        cond_.notify_one();
+    }
+}
+
+
+// 阻塞直到目前已经 append 的日志都写入文件，只在 LOG_FATAL 这类要退出的场景使用
+void AsyncLogger::flush(){
+    if(!running_){
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t seq = ++flushRequested_;
+    cond_.notify_one();
+    while(flushCompleted_ < seq && running_){
+        flushedCond_.wait(lock);
+    }
+}
+
+
+void AsyncLogger::output(const char* msg, size_t len){
+    AsyncLogger* logger = g_asyncLogger;
+    if(logger){
+        logger->append(msg, len);
+    }else{
+        ::fwrite(msg, 1, len, stdout);
+    }
+}
+
+
+void AsyncLogger::flushOutput(){
+    AsyncLogger* logger = g_asyncLogger;
+    if(logger){
+        logger->flush();
+    }
+}
+
+
+/*
+函数功能：
+    后端线程。临界区内只交换缓冲区指针，写文件全部在锁外进行
+*/
+void AsyncLogger::threadFunc(){
+    LogFile output(basename_, rollSize_);
+    BufferPtr newBuffer1(new LogBuffer);
+    BufferPtr newBuffer2(new LogBuffer);
+    BufferVector buffersToWrite;
+    buffersToWrite.reserve(16);
+
+    bool exiting = false;
+    while(!exiting){
+        uint64_t flushSeq = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(buffers_.empty() && running_ && flushRequested_ == flushCompleted_){
+                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            }
+            exiting = !running_;
+            flushSeq = flushRequested_;
+
+            buffers_.push_back(std::move(currentBuffer_));
+            currentBuffer_ = std::move(newBuffer1);
+            buffersToWrite.swap(buffers_);
+            if(!nextBuffer_){
+                nextBuffer_ = std::move(newBuffer2);
+            }
+        }
+
+        // 前端产生日志的速度远远超过写盘速度时，丢掉多余的日志，避免内存无限增长
+        if(buffersToWrite.size() > 25){
+            char buf[256];
+            int n = snprintf(buf, sizeof buf, "[ERROR]%s : dropped log messages, %lu larger buffers\n",
+                                Timestamp::now().toString().c_str(), buffersToWrite.size() - 2);
+            fputs(buf, stderr);
+            output.append(buf, n);
+            buffersToWrite.resize(2);
+        }
+
+        for(const BufferPtr& buffer : buffersToWrite){
+            output.append(buffer->data(), buffer->length());
+        }
+
+        // 留下两块缓冲区重新使用，其余的释放
+        if(buffersToWrite.size() > 2){
+            buffersToWrite.resize(2);
+        }
+        if(!newBuffer1){
+            newBuffer1 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer1->reset();
+        }
+        if(!newBuffer2 && !buffersToWrite.empty()){
+            newBuffer2 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer2->reset();
+        }
+        if(!newBuffer2){
+            newBuffer2.reset(new LogBuffer);
+        }
+        buffersToWrite.clear();
+        output.flush();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            flushCompleted_ = flushSeq;
+        }
+        flushedCond_.notify_all();
+    }
+}
@@ -0,0 +1,384 @@
+#include "BinaryLog.h"
+#include "LogFile.h"
+#include "CurrentThread.h"
+
+#include <chrono>
+#include <thread>
+
+
+// start() 之后 Logger::flush 转发到的对象
+static std::atomic<BinaryLogger*> g_binaryLogger(nullptr);
+
+static const char kFileMagic[] = "MUDUOBL1";
+static const uint64_t kCalibrateIntervalNs = 1000*1000*1000;     // 每秒写一次校准点
+
+const size_t BinaryLogger::kRecordHeaderSize;
+const size_t BinaryLogger::kRingSize;
+const size_t BinaryLogger::kMaxStringArg;
+
+std::atomic_bool BinaryLogger::active_(false);
+std::mutex BinaryLogger::registryMutex_;
+std::vector<BinaryLogger::Site> BinaryLogger::sites_;
+std::vector<BinaryLogger::Ring*> BinaryLogger::rings_;
+__thread BinaryLogger::Ring* BinaryLogger::t_ring_ = nullptr;
+__thread uint64_t BinaryLogger::t_pendingHead_ = 0;
+
+
+// 线程退出时把它的环形缓冲区标记为 retired，后端读完剩余的日志后释放
+struct BinaryLogger::RingHolder{
+    Ring* ring = nullptr;
+
+    ~RingHolder(){
+        if(ring){
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+
+static uint64_t realtimeNs(){
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+template <typename T>
+static void appendRaw(std::string& buf, T v){
+    buf.append(reinterpret_cast<const char*>(&v), sizeof v);
+}
+
+
+BinaryLogger::BinaryLogger(const std::string& basename, off_t rollSize, int drainIntervalMs)
+    : basename_(basename)
+    , rollSize_(rollSize)
+    , drainIntervalMs_(drainIntervalMs)
+    , running_(false)
+    , thread_(std::bind(&BinaryLogger::threadFunc, this), "BinaryLogger")
+    , sitesWritten_(0)
+    , rollCount_(0)
+    , lastCalibrateNs_(0)
+    , baseTicks_(0)
+    , baseNs_(0)
+    , ticksPerNs_(1.0)
+    , flushRequested_(0)
+    , flushCompleted_(0)
+{
+    chunk_.reserve(kRingSize);
+}
+
+
+BinaryLogger::~BinaryLogger(){
+    if(running_){
+        stop();
+    }
+}
+
+
+// 启动后端线程，之后 LOG_* 写入二进制日志
+void BinaryLogger::start(){
+    running_ = true;
+    thread_.start();
+
+    g_binaryLogger = this;
+    active_ = true;
+}
+
+
+// LOG_* 恢复到文本日志，再把各线程剩余的日志写完，退出后端线程
+void BinaryLogger::stop(){
+    active_ = false;
+    g_binaryLogger = nullptr;
+
+    running_ = false;
+    cond_.notify_one();
+    thread_.join();
+}
+
+
+void BinaryLogger::flush(){
+    if(!running_){
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t seq = ++flushRequested_;
+    cond_.notify_one();
+    while(flushCompleted_ < seq && running_){
+        flushedCond_.wait(lock);
+    }
+}
+
+
+void BinaryLogger::flushActive(){
+    BinaryLogger* logger = g_binaryLogger;
+    if(logger){
+        logger->flush();
+    }
+}
+
+
+/*
+函数功能：
+    登记一个 LOG_* 调用点，返回从 1 开始的 siteId（0 在日志记录中表示填充）
+其他解释：
+    每个调用点只在第一次执行时调用一次（宏中的函数内静态变量），所以直接加锁
+    file 和 fmt 都是字符串字面量，只保存指针
+*/
+uint32_t BinaryLogger::registerSite(int level, const char* file, int line, const char* fmt){
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    sites_.push_back(Site{level, file, line, fmt});
+    return static_cast<uint32_t>(sites_.size());
+}
+
+
+BinaryLogger::Ring* BinaryLogger::createRing(){
+    static thread_local RingHolder holder;
+
+    Ring* ring = new Ring(CurrentThread::getTid());
+    {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        rings_.push_back(ring);
+    }
+    holder.ring = ring;
+    t_ring_ = ring;
+    return ring;
+}
+
+
+/*
+函数功能：
+    在当前线程的环形缓冲区中预留 length 字节，返回写入位置；空间不够时丢弃这条日志，返回 nullptr
+其他解释：
+    一条记录必须连续存放，到缓冲区末尾放不下时跳过剩下的部分：
+    剩余空间不少于一个记录头时写一条 siteId 为 0 的填充记录，否则后端看到剩余不足一个记录头时自己跳过
+*/
+char* BinaryLogger::reserve(size_t length){
+    Ring* ring = t_ring_;
+    if(__builtin_expect(ring == nullptr, 0)){
+        ring = createRing();
+    }
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    size_t pos = head & (kRingSize - 1);
+    size_t pad = kRingSize - pos < length ? kRingSize - pos : 0;
+    if(head + pad + length - ring->tail.load(std::memory_order_acquire) > kRingSize){
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    if(pad >= kRecordHeaderSize){
+        uint32_t padSite = 0;
+        uint32_t pad32 = static_cast<uint32_t>(pad);
+        memcpy(ring->data + pos, &padSite, 4);
+        memcpy(ring->data + pos + 4, &pad32, 4);
+    }
+    t_pendingHead_ = head + pad + length;
+    return ring->data + ((head + pad) & (kRingSize - 1));
+}
+
+
+// 发布 reserve 预留的记录，后端 acquire 读到 head 之后就能看到完整的记录
+void BinaryLogger::commit(){
+    t_ring_->head.store(t_pendingHead_, std::memory_order_release);
+}
+
+
+/*
+函数功能：
+    后端线程。每隔 drainIntervalMs_ 毫秒（或有 flush 请求时）把所有线程的环形缓冲区搬到文件中
+*/
+void BinaryLogger::threadFunc(){
+    // 先用一小段时间估计 tsc 的频率，之后随着基线变长不断修正
+    baseTicks_ = ticks();
+    baseNs_ = realtimeNs();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    updateTickRate();
+
+    LogFile output(basename_, rollSize_);
+    sitesWritten_ = 0;
+    rollCount_ = 0;
+
+    bool exiting = false;
+    while(!exiting){
+        uint64_t flushSeq = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(running_ && flushRequested_ == flushCompleted_){
+                cond_.wait_for(lock, std::chrono::milliseconds(drainIntervalMs_));
+            }
+            exiting = !running_;
+            flushSeq = flushRequested_;
+        }
+
+        drainRings(output);
+        if(realtimeNs() - lastCalibrateNs_ >= kCalibrateIntervalNs){
+            updateTickRate();
+            writeCalibration(output);
+        }
+        output.flush();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            flushCompleted_ = flushSeq;
+        }
+        flushedCond_.notify_all();
+    }
+}
+
+
+/*
+函数功能：
+    把各线程环形缓冲区中已经发布的记录写入文件
+其他解释：
+    先 acquire 各个缓冲区的 head，再读调用点的个数：读到的记录所引用的调用点一定已经登记过了
+    已经退出的线程的缓冲区读空之后在这里释放
+*/
+void BinaryLogger::drainRings(LogFile& output){
+    std::vector<std::pair<Ring*, uint64_t>> heads;
+    size_t siteCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        for(auto it = rings_.begin(); it != rings_.end(); ){
+            Ring* ring = *it;
+            bool retired = ring->retired.load(std::memory_order_acquire);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            if(retired && head == ring->tail.load(std::memory_order_relaxed)
+                && ring->dropped.load(std::memory_order_relaxed) == ring->droppedReported){
+                delete ring;
+                it = rings_.erase(it);
+                continue;
+            }
+            heads.push_back(std::make_pair(ring, head));
+            ++it;
+        }
+        siteCount = sites_.size();
+    }
+
+    writeSites(output, siteCount);
+
+    for(const auto& item : heads){
+        Ring* ring = item.first;
+        uint64_t head = item.second;
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+
+        if(tail != head){
+            // 条目头：类型 | tid | 字节数，字节数在拷贝完记录后回填
+            chunk_.clear();
+            chunk_.push_back(static_cast<char>(kEntryRecords));
+            appendRaw(chunk_, static_cast<uint32_t>(ring->tid));
+            appendRaw(chunk_, static_cast<uint32_t>(0));
+
+            while(tail != head){
+                size_t pos = tail & (kRingSize - 1);
+                size_t remain = kRingSize - pos;
+                if(remain < kRecordHeaderSize){
+                    tail += remain;
+                    continue;
+                }
+                uint32_t siteId = 0;
+                uint32_t length = 0;
+                memcpy(&siteId, ring->data + pos, 4);
+                memcpy(&length, ring->data + pos + 4, 4);
+                if(siteId != 0){
+                    chunk_.append(ring->data + pos, length);
+                }
+                tail += length;
+            }
+            ring->tail.store(tail, std::memory_order_release);
+
+            uint32_t bytes = static_cast<uint32_t>(chunk_.size() - 9);
+            memcpy(&chunk_[5], &bytes, 4);
+            if(bytes > 0){
+                appendEntry(output, chunk_.data(), chunk_.size());
+            }
+        }
+
+        uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+        if(dropped != ring->droppedReported){
+            ring->droppedReported = dropped;
+            std::string entry;
+            entry.push_back(static_cast<char>(kEntryDropped));
+            appendRaw(entry, static_cast<uint32_t>(ring->tid));
+            appendRaw(entry, dropped);
+            appendEntry(output, entry.data(), entry.size());
+        }
+    }
+}
+
+
+/*
+函数功能：
+    写入一个完整的条目。LogFile 滚动到新文件之后，先在新文件开头写文件头、全部调用点和校准点，
+    保证每个文件都可以单独解码
+*/
+void BinaryLogger::appendEntry(LogFile& output, const char* data, size_t len){
+    if(output.rollCount() != rollCount_){
+        rollCount_ = output.rollCount();
+        output.append(kFileMagic, sizeof kFileMagic - 1);
+        sitesWritten_ = 0;
+        writeCalibration(output);
+
+        size_t siteCount = 0;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex_);
+            siteCount = sites_.size();
+        }
+        writeSites(output, siteCount);
+    }
+    output.append(data, len);
+}
+
+
+// 写入 [sitesWritten_, siteCount) 范围内的调用点定义
+void BinaryLogger::writeSites(LogFile& output, size_t siteCount){
+    if(sitesWritten_ >= siteCount){
+        return;
+    }
+
+    std::vector<Site> sites;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        sites.assign(sites_.begin() + sitesWritten_, sites_.begin() + siteCount);
+    }
+
+    std::string entry;
+    for(size_t i = 0; i < sites.size(); ++i){
+        const Site& site = sites[i];
+        uint16_t fileLen = static_cast<uint16_t>(strlen(site.file));
+        uint16_t fmtLen = static_cast<uint16_t>(strlen(site.fmt));
+
+        entry.clear();
+        entry.push_back(static_cast<char>(kEntrySite));
+        appendRaw(entry, static_cast<uint32_t>(sitesWritten_ + i + 1));
+        appendRaw(entry, static_cast<uint8_t>(site.level));
+        appendRaw(entry, static_cast<uint32_t>(site.line));
+        appendRaw(entry, fileLen);
+        entry.append(site.file, fileLen);
+        appendRaw(entry, fmtLen);
+        entry.append(site.fmt, fmtLen);
+        appendEntry(output, entry.data(), entry.size());
+    }
+    sitesWritten_ = siteCount;
+}
+
+
+void BinaryLogger::writeCalibration(LogFile& output){
+    std::string entry;
+    entry.push_back(static_cast<char>(kEntryCalibrate));
+    appendRaw(entry, ticks());
+    appendRaw(entry, realtimeNs());
+    appendRaw(entry, ticksPerNs_);
+    lastCalibrateNs_ = realtimeNs();
+    appendEntry(output, entry.data(), entry.size());
+}
+
+
+// 用后端线程启动以来的 tsc 增量和真实时间增量计算 tsc 的频率
+void BinaryLogger::updateTickRate(){
+    uint64_t nowTicks = ticks();
+    uint64_t nowNs = realtimeNs();
+    if(nowNs > baseNs_ && nowTicks > baseTicks_){
+        ticksPerNs_ = static_cast<double>(nowTicks - baseTicks_) / static_cast<double>(nowNs - baseNs_);
+    }
+}
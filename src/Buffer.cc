@@ -2,6 +2,9 @@
 #include <errno.h>
 #include <sys/uio.h>        // iovec
 #include <unistd.h>         // write
+#include <string.h>         // memset
+#include <sys/socket.h>     // recvmsg
+#include <linux/errqueue.h> // scm_timestamping
 
 
 /*
@@ -13,15 +16,20 @@ ssize_t Buffer::readFd(int fd, int* saveErrno){
     struct iovec vec[2];
 
     const size_t writable = writableBytes();    // Buffer底层缓冲区，剩余的可写空间大小
-    vec[0].iov_base = begin() + writerIndex_;   // 缓冲区中可写空间的起始位置
-    vec[0].iov_len = writable;                  // 可写空间的大小
+    int iovecnt = 0;
+    if(writable > 0){                           // 还没有分配内存的缓冲区直接读到栈上
+        vec[iovecnt].iov_base = beginWrite();   // 缓冲区中可写空间的起始位置
+        vec[iovecnt].iov_len = writable;        // 可写空间的大小
+        ++iovecnt;
+    }
 
     // 缓冲区中可写空间不足，则将栈上的内存空间作为可写空间
-    vec[1].iov_base = extrabuf;                 // 栈上的内存空间
-    vec[1].iov_len = sizeof extrabuf;           // 栈上的内存空间的大小
+    if(writable < sizeof extrabuf){
+        vec[iovecnt].iov_base = extrabuf;       // 栈上的内存空间
+        vec[iovecnt].iov_len = sizeof extrabuf; // 栈上的内存空间的大小
+        ++iovecnt;
+    }
 
-    // 设置可写空间。如果可写空间不足，则将栈上的内存空间作为可写空间（iovecnt = 2，表示选择使用第2块空间）
-    const int iovecnt = (writable < sizeof extrabuf) ? 2 : 1;
     const ssize_t n = readv(fd, vec, iovecnt);  // 读取数据
 
     if(n < 0){                  // 读取失败
@@ -29,7 +37,7 @@ ssize_t Buffer::readFd(int fd, int* saveErrno){
     }else if(n <= writable){    // 读取成功，且数据量小于可写空间
         writerIndex_ += n;
     }else{                      // 读取成功，且数据量大于可写空间，extrabuf 也写入了数据
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable;
         append(extrabuf, n - writable); // writerIndex_ 开始写 n - writable 大小的数据
     }
 
@@ -38,6 +46,68 @@ ssize_t Buffer::readFd(int fd, int* saveErrno){
 
 
 
+/*
+函数功能：
+    和 readFd 一样的两块 iovec，改用 recvmsg，从控制消息中取出内核的接收时间
+其他解释：
+    SO_TIMESTAMPING 的软件时间戳在 scm_timestamping.ts[0]，SO_TIMESTAMPNS 直接是一个 timespec
+*/
+ssize_t Buffer::readFdWithTimestamp(int fd, int* saveErrno, Timestamp* kernelTime){
+    char extrabuf[65536];
+    struct iovec vec[2];
+
+    const size_t writable = writableBytes();
+    int iovecnt = 0;
+    if(writable > 0){
+        vec[iovecnt].iov_base = beginWrite();
+        vec[iovecnt].iov_len = writable;
+        ++iovecnt;
+    }
+    if(writable < sizeof extrabuf){
+        vec[iovecnt].iov_base = extrabuf;
+        vec[iovecnt].iov_len = sizeof extrabuf;
+        ++iovecnt;
+    }
+
+    char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = iovecnt;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    const ssize_t n = ::recvmsg(fd, &msg, 0);
+    if(n < 0){
+        *saveErrno = errno;
+        return n;
+    }
+
+    for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+        if(cmsg->cmsg_level != SOL_SOCKET){
+            continue;
+        }
+        const struct timespec* ts = nullptr;
+        if(cmsg->cmsg_type == SCM_TIMESTAMPING){
+            ts = &reinterpret_cast<const struct scm_timestamping*>(CMSG_DATA(cmsg))->ts[0];
+        }else if(cmsg->cmsg_type == SCM_TIMESTAMPNS){
+            ts = reinterpret_cast<const struct timespec*>(CMSG_DATA(cmsg));
+        }
+        if(ts && (ts->tv_sec != 0 || ts->tv_nsec != 0)){
+            *kernelTime = Timestamp(static_cast<int64_t>(ts->tv_sec) * Timestamp::kMicroSecondsPerSecond + ts->tv_nsec / 1000);
+        }
+    }
+
+    if(static_cast<size_t>(n) <= writable){
+        writerIndex_ += n;
+    }else{
+        writerIndex_ += writable;
+        append(extrabuf, n - writable);
+    }
+    return n;
+}
+
+
 ssize_t Buffer::writeFd(int fd, int *saveErrno){
     ssize_t n = ::write(fd, peek(), readableBytes());
     if(n < 0){
@@ -4,6 +4,7 @@
 
 #include "EventLoop.h"
 #include "Logger.h"
+#include "Probes.h"
 
 const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;  // 该变量表示文件描述符可读事件的掩码，即当文件描述符上发生可读事件时，会触发该掩码对应的事件。其中，EPOLLIN表示可读事件，EPOLLPRI表示紧急可读事件。 
@@ -64,6 +65,7 @@ void Channel::remove(){
     事件处理函数:fd得到poller通知后，处理事件的
 */ 
 void Channel::handleEvent(Timestamp receiveTime){
+    MUDUO_PROBE3(channel_handle, loop_, fd_, revents_);
     if(tied_){
         // std::weak_ptr的lock()方法用于检查所观察的对象是否仍然存在，如果存在，则返回一个有效的std::shared_ptr，
         // 否则返回一个空的std::shared_ptr。这是std::weak_ptr的一个重要功能，
@@ -83,11 +85,11 @@ void Channel::handleEvent(Timestamp receiveTime){
     根据poller 通知的channel发生的具体事件，由channel负责调用具体的回调操作
 */ 
 void Channel::handleEventWithGuard(Timestamp receiveTime){
-    LOG_INFO("channel handleEvent revents %d\n", revents_);
+    LOG_DEBUG("channel handleEvent revents %d\n", revents_);
 
-    // 通常一个套接字不会同时既是挂起的（HUP）又可读（IN）。
-    // 如果发生了这种情况，可能表示一种特殊的情况，比如套接字在关闭过程中，但仍有数据待读取。
-    if( (revents_ & EPOLLHUP) && (revents_ & EPOLLIN) ){    
+    // 挂起（HUP）且没有可读事件（IN）时直接关闭；同时可读时，交给读回调，read 返回 0 后再关闭。
+    // 连接被暂停读（没有注册 EPOLLIN）时，对端关闭只能通过这里发现。
+    if( (revents_ & EPOLLHUP) && !(revents_ & EPOLLIN) ){    
         if( closeCallback_ ){
             closeCallback_();
         }
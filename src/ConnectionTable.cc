@@ -0,0 +1,77 @@
+#include "ConnectionTable.h"
+#include "Logger.h"
+
+
+ConnectionTable::ConnectionTable()
+    : size_(0)
+{
+}
+
+
+/*
+函数功能：
+    占用一个空槽位，返回 (generation << 32 | index) 作为新连接的 id
+其他解释：
+    代数从 1 开始，回绕时跳过 0，保证 id 不为 0（0 可以当作“没有连接”使用）
+*/
+uint64_t ConnectionTable::acquire(){
+    uint32_t index;
+    if(!freeSlots_.empty()){
+        index = freeSlots_.back();
+        freeSlots_.pop_back();
+    }else{
+        if(slots_.size() > UINT32_MAX){
+            LOG_FATAL("ConnectionTable::acquire - too many connections:%lu\n", slots_.size());
+        }
+        index = static_cast<uint32_t>(slots_.size());
+        slots_.push_back(Slot{TcpConnectionPtr(), 1});
+    }
+    ++size_;
+    return (static_cast<uint64_t>(slots_[index].generation) << 32) | index;
+}
+
+
+void ConnectionTable::set(uint64_t id, const TcpConnectionPtr& conn){
+    Slot& slot = slots_[indexOf(id)];
+    if(slot.generation == generationOf(id)){
+        slot.conn = conn;
+    }
+}
+
+
+const ConnectionTable::Slot* ConnectionTable::lookup(uint64_t id) const{
+    uint32_t index = indexOf(id);
+    if(index >= slots_.size() || slots_[index].generation != generationOf(id)){
+        return nullptr;
+    }
+    return &slots_[index];
+}
+
+
+TcpConnectionPtr ConnectionTable::find(uint64_t id) const{
+    const Slot* slot = lookup(id);
+    return slot ? slot->conn : TcpConnectionPtr();
+}
+
+
+bool ConnectionTable::remove(uint64_t id){
+    if(lookup(id) == nullptr){
+        return false;
+    }
+    uint32_t index = indexOf(id);
+    Slot& slot = slots_[index];
+    slot.conn.reset();
+    if(++slot.generation == 0){
+        slot.generation = 1;
+    }
+    freeSlots_.push_back(index);
+    --size_;
+    return true;
+}
+
+
+void ConnectionTable::clear(){
+    slots_.clear();
+    freeSlots_.clear();
+    size_ = 0;
+}
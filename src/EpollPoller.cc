@@ -1,6 +1,8 @@
 #include "EpollPoller.h"
 #include "Logger.h"
 #include "Channel.h"
+#include "Metrics.h"
+#include "Probes.h"
 
 #include <sys/errno.h>
 #include <unistd.h>     // close
@@ -51,7 +53,7 @@ EPollPoller::~EPollPoller() {
 */ 
 void EPollPoller::updateChannel(Channel *channel){
     const int index = channel->getIndex();
-    LOG_INFO("fd=%d events=%d index=%d\n", channel->getFd(), channel->getEvents(), index);
+    LOG_DEBUG("fd=%d events=%d index=%d\n", channel->getFd(), channel->getEvents(), index);
 
     // 如果channel 没有在poller中，则添加进去
     if(index == kNew || index == kDeleted){
@@ -87,7 +89,7 @@ void EPollPoller::updateChannel(Channel *channel){
 void EPollPoller::removeChannel(Channel *channel){
     int fd = channel->getFd();          // 获取channel的fd
     int index = channel->getIndex();    // 获取channel在Poller的状态，只是奇怪这个命名陈硕大神为什么不用state
-    LOG_INFO("fd=%d index=%d\n", fd, index);
+    LOG_DEBUG("fd=%d index=%d\n", fd, index);
 
     channels_.erase(fd);
     if(index == kAdded){
@@ -107,16 +109,20 @@ void EPollPoller::removeChannel(Channel *channel){
         通过EventLoop，调用了poller.poll方法，通过 epoll_wait, 将监听到发生事件的channel，告知到EventLoop
 */
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels){
-    // 实际上应该用 LOG_DEBUG 输出日志更为合理，因为在高并发的情况下，LOG_INFO可能会影响poll的性能
-    LOG_INFO("fd total count:%lu\n", channels_.size());
+    // 这里用 LOG_DEBUG，高并发的情况下每次poll都输出日志会影响性能
+    LOG_DEBUG("fd total count:%lu\n", channels_.size());
 
+    MUDUO_PROBE3(poll_entry, ownerLoop(), timeoutMs, channels_.size());
     // &*events_.begin() 表示vector容器的起始地址
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs); // 最多只会返回events_.size()个事件
     int saveErrno = errno;  // 高并发时，可能多个epoll_wait都会出错，均会写errno，所以先用局部变量存储errno。（注意，依然可能会出问题）
-    Timestamp now(Timestamp::now());
+    Timestamp now(Timestamp::now());     // 只取一次时间，EventLoop 把它缓存为本轮的 pollReturnTime_
+    MUDUO_PROBE2(poll_return, ownerLoop(), numEvents);
 
+    metrics::core().epollWaits.inc();
     if(numEvents > 0){
-        LOG_INFO("%d events happened\n", numEvents);
+        metrics::core().eventsPerWait.observe(numEvents);
+        LOG_DEBUG("%d events happened\n", numEvents);
         fillActiveChannels(numEvents, activeChannels);  // 将监听到发生事件的活跃连接，写入到ChannelList（EventLoop的另一个组件）中
         if(numEvents == events_.size()){
             events_.resize( events_.size()*2 );
@@ -130,7 +136,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels){
         }
     }
 
-    return Timestamp::now();
+    return now;
 }
 
 
@@ -163,6 +169,7 @@ void EPollPoller::update(int operation, Channel *channel){
     event.data.fd = fd;
     event.data.ptr = channel;   // 将channel保存到epoll_event中
 
+    metrics::core().epollCtls.inc();
     if(::epoll_ctl(epollfd_, operation, fd, &event) < 0){
         if(operation == EPOLL_CTL_DEL){
             LOG_ERROR("epoll_ctl del error:%d\n", errno);       // 如果没删除成功，影响也不是致命的
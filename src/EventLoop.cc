@@ -1,6 +1,10 @@
 #include "EventLoop.h"
 
 #include "Logger.h"
+#include "Metrics.h"
+#include "Probes.h"
+#include "PerfCounters.h"
+#include "AllocTracker.h"
 #include "Poller.h"      // Poller的getDefaultPoller方法是在DefaultPoller中实现的
 
 #include <sys/eventfd.h>
@@ -38,6 +42,13 @@ EventLoop::EventLoop()
     , poller_(Poller::getDefaultPoller(this))       // 传入了EventLoop类的对象 loop
     , wakeupFd_(createEventfd())                   
     , wakeupChannel_(new Channel(this, wakeupFd_))  // 将 当前loop 和 wakeupFd_ 打包成 wakeupChannel_
+    , iterations_(0)
+    , callbackStart_(0)
+    , busyMicros_(0)
+    , statsSince_(Timestamp::now())
+    , statsEnabled_(false)
+    , heartbeat_(std::make_shared<Heartbeat>(threadId_))
+    , heartbeatEnabled_(false)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     if(t_loopInThisThread){                         // 该线程已存在一个 EventLoop
@@ -58,6 +69,7 @@ EventLoop::~EventLoop(){
     wakeupChannel_->disableAll();   // 取消对所有事件的监听
     wakeupChannel_->remove();       // 将channel从poller中移除
     ::close(wakeupFd_);
+    heartbeat_->set(Heartbeat::kExited, -1, 0);
     t_loopInThisThread = nullptr;
 }
 
@@ -78,17 +90,48 @@ void EventLoop::loop(){
 
     while(!quit_){
         activateChannles_.clear();
+        metrics::core().loopIterations.inc();
+        const bool heartbeat = heartbeatEnabled_.load(std::memory_order_relaxed);     // 每轮只读一次
+        const bool stats = statsEnabled_.load(std::memory_order_relaxed);
+        const bool timed = stats || heartbeat;      // 心跳里的回调开始时间同样来自 recordCallback
+        if(heartbeat){
+            heartbeat_->set(Heartbeat::kPolling, -1, 0);
+        }
+        MUDUO_ALLOC_SET_SITE("EventLoop::poll");
         pollReturnTime_ = poller_->poll(kPollTimeMs, &activateChannles_);   // 监听两类fd：client的fd，wakeup的fd（问题：这两个fd是何时，如何注册到poller中的？）
+        ++iterations_;
+        callbackStart_ = pollReturnTime_.microSecondsSinceEpoch();
+        if(perf_){
+            perf_->endPhase(PerfCounters::kPoll);
+        }
+        MUDUO_ALLOC_SET_SITE("EventLoop::io");
         for(Channel* channel: activateChannles_){
+            if(heartbeat){
+                heartbeat_->set(Heartbeat::kIoCallback, channel->getFd(), callbackStart_);
+            }
             channel->handleEvent(pollReturnTime_);  // 触发回调（该回调函数具体执行的功能，该功能需要再创建channel时候注册）
+            if(timed){
+                recordCallback(channel->getFd());
+            }
+        }
+        if(perf_){
+            perf_->endPhase(PerfCounters::kIo);
         }
 
         // 执行待处理的函数对象（functors），这些functors可能是事件循环外部提交给事件循环线程的任务，
         // 通过这种方式实现线程安全的任务队列处理。
         // 这有助于扩展事件循环的功能，使其不仅能处理I/O事件，还能处理定时任务、延后执行的任务等
-        doPendingFunctors();
+        MUDUO_ALLOC_SET_SITE("EventLoop::functors");
+        doPendingFunctors(heartbeat, timed);
+        if(perf_){
+            perf_->endPhase(PerfCounters::kFunctors);
+        }
+        if(stats){
+            busyMicros_ += callbackStart_ - pollReturnTime_.microSecondsSinceEpoch();
+        }
     }
 
+    MUDUO_ALLOC_SET_SITE(nullptr);
     LOG_INFO("EventLoop %p stop looping. \n", this);
     looping_ = false;
 }   
@@ -111,7 +154,7 @@ void EventLoop::runInLoop(Functor cb){
     if (isInLoopThread()){  // 在当前的loop线程中，执行cb
         cb();
     }else{                  // 在非当前loop线程中，执行cb，就需要唤醒其他loop线程，执行cb
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 
@@ -120,8 +163,10 @@ void EventLoop::runInLoop(Functor cb){
 void EventLoop::queueInLoop(Functor cb){
     {
         std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
+        MUDUO_ALLOC_SITE("EventLoop::queueInLoop");
+        pendingFunctors_.emplace_back(std::move(cb));   // move进队列，避免拷贝回调中绑定的数据
     }
+    metrics::core().functorsQueued.inc();
 
     // 唤醒相应的，需要执行上面回调操作的loop的线程了
     // || callingPendingFunctors_ 表示 doPendingFunctors中回调还没执行完，loop中又阻塞在poll上，
@@ -146,6 +191,8 @@ void EventLoop::handleRead(){
 // mainLoop用的。用来唤醒loop所在的线程, 向 wakeupfd_ 写一个数据, wakeupChannel_ 就发生读事件，当前loop线程就会被唤醒
 void EventLoop::wakeup(){
     uint64_t one = 1;
+    metrics::core().wakeups.inc();
+    MUDUO_PROBE1(loop_wakeup, this);
     ssize_t n = ::write(wakeupFd_, &one, sizeof one);
     if(n != sizeof one){
         LOG_ERROR("EventLoop::wakeup() writes %lu bytes instead of 8\n", n);
@@ -171,7 +218,7 @@ bool EventLoop::hasChannel(Channel* channel){
 
 
 // 执行回调函数。注意，回调是在vector容器中存放的，谁可以在这里写回调？TcpServer
-void EventLoop::doPendingFunctors(){
+void EventLoop::doPendingFunctors(bool heartbeat, bool timed){
     std::vector<Functor> fucntors;  
     callingPendingFunctors_ = true;
 
@@ -179,12 +226,115 @@ void EventLoop::doPendingFunctors(){
         std::unique_lock<std::mutex> lock(mutex_);
         fucntors.swap(pendingFunctors_);
     }
+    if(!fucntors.empty()){
+        metrics::core().functorQueueDepth.observe(static_cast<double>(fucntors.size()));
+    }
+    MUDUO_PROBE2(functors_run, this, fucntors.size());
 
     // 使用局部变量，即使没有执行完回调函数，也不妨碍mainLoop继续向pendingFunctors_写回调
     for(const Functor& functor : fucntors){
+        if(heartbeat){
+            heartbeat_->set(Heartbeat::kFunctor, -1, callbackStart_);
+        }
         functor();  // 执行当前 loop 需要执行的回调操作
+        if(timed){
+            recordCallback(-1);
+        }
     }
+    MUDUO_PROBE2(functors_done, this, fucntors.size());
 
     callingPendingFunctors_ = false;
 }
 
+
+/*
+函数功能：
+    回调结束时取一次时间，和开始时间相减得到耗时，保留最慢的 kMaxSlowCallbacks 个
+其他解释：
+    每个回调只多一次 vDSO 的 clock_gettime。本次的结束时间就是下一个回调的开始时间。
+    只写心跳、没有开启统计时，只更新开始时间
+*/
+void EventLoop::recordCallback(int fd){
+    Timestamp now(Timestamp::now());
+    int64_t micros = now.microSecondsSinceEpoch() - callbackStart_;
+    callbackStart_ = now.microSecondsSinceEpoch();
+    if(!statsEnabled_.load(std::memory_order_relaxed)){
+        return;
+    }
+
+    if(slowest_.size() < kMaxSlowCallbacks || micros > slowest_.back().micros){
+        SlowCallback cb = { micros, fd, now };
+        auto pos = slowest_.begin();
+        while(pos != slowest_.end() && pos->micros >= micros){
+            ++pos;
+        }
+        slowest_.insert(pos, cb);
+        if(slowest_.size() > kMaxSlowCallbacks){
+            slowest_.pop_back();
+        }
+    }
+}
+
+
+const std::shared_ptr<EventLoop::Heartbeat>& EventLoop::enableHeartbeat(){
+    heartbeatEnabled_.store(true, std::memory_order_relaxed);
+    return heartbeat_;
+}
+
+
+bool EventLoop::enablePerfCounters(){
+    if(!isInLoopThread()){
+        LOG_ERROR("EventLoop::enablePerfCounters must be called in the loop thread\n");
+        return false;
+    }
+    if(!perf_){
+        std::unique_ptr<PerfCounters> perf(new PerfCounters(std::to_string(threadId_)));
+        if(perf->valid()){
+            perf_ = std::move(perf);
+        }
+    }
+    return perf_ != nullptr;
+}
+
+
+void EventLoop::enableStats(){
+    if(!statsEnabled_.exchange(true)){
+        runInLoop(std::bind(&EventLoop::resetStatsWindow, this));
+    }
+}
+
+
+void EventLoop::resetStatsWindow(){
+    busyMicros_ = 0;
+    statsSince_ = Timestamp::now();
+    slowest_.clear();
+}
+
+
+/*
+其他解释：
+    读取不会清空统计，多个 /status 的读者互不影响；需要新窗口时由调用方显式 reset
+*/
+EventLoop::Stats EventLoop::stats(bool resetWindow){
+    Stats s;
+    s.tid = threadId_;
+    s.channels = poller_->numChannels();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        s.pendingFunctors = pendingFunctors_.size();
+    }
+    s.iterations = iterations_;
+
+    Timestamp now(Timestamp::now());
+    s.windowSeconds = timeDifference(now, statsSince_);
+    s.utilization = s.windowSeconds > 0 ? busyMicros_ / (s.windowSeconds * Timestamp::kMicroSecondsPerSecond) : 0.0;
+    if(s.utilization > 1.0){
+        s.utilization = 1.0;
+    }
+    s.slowest = slowest_;
+
+    if(resetWindow){
+        resetStatsWindow();
+    }
+    return s;
+}
@@ -0,0 +1,234 @@
+#include "LogFile.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>     // memcpy
+#include <errno.h>
+#include <fcntl.h>      // open、posix_fallocate、sync_file_range
+#include <unistd.h>     // gethostname、getpid、ftruncate
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+const size_t LogFile::kMapWindowSize;
+
+
+LogFile::LogFile(const std::string& basename, off_t rollSize, int flushInterval, int checkEveryN)
+    : basename_(basename)
+    , rollSize_(rollSize)
+    , flushInterval_(flushInterval)
+    , checkEveryN_(checkEveryN)
+    , count_(0)
+    , startOfPeriod_(0)
+    , lastRoll_(0)
+    , lastFlush_(0)
+    , fd_(-1)
+    , window_(nullptr)
+    , windowOffset_(0)
+    , windowPos_(0)
+    , syncedPos_(0)
+    , writtenBytes_(0)
+    , rollCount_(0)
+    , droppedBytes_(0)
+{
+    rollFile();
+}
+
+
+LogFile::~LogFile(){
+    closeFile();
+    if(droppedBytes_ > 0){
+        fprintf(stderr, "LogFile::~LogFile() %ld bytes of log dropped\n", static_cast<long>(droppedBytes_));
+    }
+}
+
+
+/*
+函数功能：
+    追加一段日志，只是 memcpy 到映射区。当前窗口写满时映射下一个窗口
+其他解释：
+    打开文件或者映射窗口失败（比如磁盘满）时没有可写的窗口，日志丢弃并计数。
+    每秒最多重试一次 rollFile，开始丢弃时和恢复时各向 stderr 报告一次
+*/
+void LogFile::append(const char* logline, size_t len){
+    if(window_ == nullptr){
+        if(::time(NULL) > lastRoll_){
+            rollFile();
+        }
+        if(window_ == nullptr){
+            dropBytes(len);
+            return;
+        }
+        if(droppedBytes_ > 0){
+            fprintf(stderr, "LogFile::append() recovered, %ld bytes of log dropped\n", static_cast<long>(droppedBytes_));
+            droppedBytes_ = 0;
+        }
+    }
+
+    size_t written = 0;
+    while(written != len){
+        size_t n = std::min(len - written, kMapWindowSize - windowPos_);
+        memcpy(window_ + windowPos_, logline + written, n);
+        windowPos_ += n;
+        written += n;
+        if(windowPos_ == kMapWindowSize && !mapWindow(windowOffset_ + kMapWindowSize)){
+            dropBytes(len - written);
+            break;
+        }
+    }
+    writtenBytes_ += written;
+
+    if(writtenBytes_ > rollSize_){
+        rollFile();
+    }else if(++count_ >= checkEveryN_){
+        count_ = 0;
+        time_t now = ::time(NULL);
+        time_t thisPeriod = now / kRollPerSeconds_ * kRollPerSeconds_;
+        if(thisPeriod != startOfPeriod_){
+            rollFile();
+        }else if(now - lastFlush_ > flushInterval_){
+            lastFlush_ = now;
+            flush();
+        }
+    }
+}
+
+
+// 记录丢弃的日志字节数，开始丢弃时报告一次
+void LogFile::dropBytes(size_t len){
+    if(len == 0){
+        return;
+    }
+    if(droppedBytes_ == 0){
+        fprintf(stderr, "LogFile::append() no writable log file, dropping logs until it can be reopened\n");
+    }
+    droppedBytes_ += len;
+}
+
+
+/*
+函数功能：
+    发起脏页的异步写回，不等待磁盘
+其他解释：
+    Linux 上 msync(MS_ASYNC) 几乎什么都不做，真正让内核开始写回的是 sync_file_range(SYNC_FILE_RANGE_WRITE)
+*/
+void LogFile::flush(){
+    if(window_ == nullptr || windowPos_ == syncedPos_){
+        return;
+    }
+
+    static const size_t kPageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t start = syncedPos_ / kPageSize * kPageSize;
+    ::msync(window_ + start, windowPos_ - start, MS_ASYNC);
+    ::sync_file_range(fd_, windowOffset_ + start, windowPos_ - start, SYNC_FILE_RANGE_WRITE);
+    syncedPos_ = windowPos_;
+}
+
+
+/*
+函数功能：
+    切换到新的日志文件。同一秒内不重复切换，避免生成同名文件
+*/
+bool LogFile::rollFile(){
+    time_t now = 0;
+    std::string filename = getLogFileName(basename_, &now);
+    time_t start = now / kRollPerSeconds_ * kRollPerSeconds_;
+
+    if(now > lastRoll_){
+        lastRoll_ = now;
+        lastFlush_ = now;
+        startOfPeriod_ = start;
+
+        closeFile();
+        fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if(fd_ < 0){
+            fprintf(stderr, "LogFile::rollFile() open %s failed\n", filename.c_str());
+            return false;
+        }
+
+        // 同名文件已经存在时接着它的末尾写
+        struct stat st;
+        off_t size = ::fstat(fd_, &st) == 0 ? st.st_size : 0;
+        writtenBytes_ = size;
+        if(mapWindow(size / kMapWindowSize * kMapWindowSize)){
+            windowPos_ = size % kMapWindowSize;
+            syncedPos_ = windowPos_;
+        }
+        ++rollCount_;
+        return true;
+    }
+    return false;
+}
+
+
+/*
+函数功能：
+    预分配 [offset, offset + kMapWindowSize) 的磁盘空间并映射成新的窗口，旧窗口先发起写回再解除映射
+其他解释：
+    用 posix_fallocate 真正分配磁盘块，而不是 ftruncate 出一个空洞文件：
+    磁盘满时在这里失败（之后的日志丢弃），而不是在 memcpy 时收到 SIGBUS
+*/
+bool LogFile::mapWindow(off_t offset){
+    if(window_){
+        flush();
+        ::munmap(window_, kMapWindowSize);
+        window_ = nullptr;
+    }
+
+    int err = ::posix_fallocate(fd_, offset, kMapWindowSize);
+    if(err != 0){
+        fprintf(stderr, "LogFile::mapWindow() fallocate failed %d\n", err);
+        return false;
+    }
+    void* addr = ::mmap(nullptr, kMapWindowSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, offset);
+    if(addr == MAP_FAILED){
+        fprintf(stderr, "LogFile::mapWindow() mmap failed %d\n", errno);
+        return false;
+    }
+
+    window_ = static_cast<char*>(addr);
+    windowOffset_ = offset;
+    windowPos_ = 0;
+    syncedPos_ = 0;
+    return true;
+}
+
+
+// 解除映射，并把文件截断到实际写入的长度，去掉预分配的部分
+void LogFile::closeFile(){
+    if(window_){
+        flush();
+        ::munmap(window_, kMapWindowSize);
+        window_ = nullptr;
+    }
+    if(fd_ >= 0){
+        ::ftruncate(fd_, writtenBytes_);
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+
+std::string LogFile::getLogFileName(const std::string& basename, time_t* now){
+    std::string filename(basename);
+
+    char timebuf[32];
+    struct tm tm;
+    *now = ::time(NULL);
+    ::localtime_r(now, &tm);
+    ::strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S.", &tm);
+    filename += timebuf;
+
+    char hostname[256] = {0};
+    if(::gethostname(hostname, sizeof hostname - 1) == 0){
+        filename += hostname;
+    }else{
+        filename += "unknownhost";
+    }
+
+    char pidbuf[32];
+    snprintf(pidbuf, sizeof pidbuf, ".%d.log", ::getpid());
+    filename += pidbuf;
+
+    return filename;
+}
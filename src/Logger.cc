@@ -1,36 +1,87 @@
 #include "Logger.h"
 #include "Timestamp.h"
 
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+
+// 默认的输出：写到标准输出。不再像 std::endl 那样逐行flush
+static void defaultOutput(const char* msg, size_t len){
+    ::fwrite(msg, 1, len, stdout);
+}
+
+static void defaultFlush(){
+    ::fflush(stdout);
+}
+
+
+// 运行时级别默认和编译期最低级别一致，定义了 MUDEBUG 编译进来的 DEBUG 日志不需要再调用 setLogLevel 才能输出
+std::atomic_int Logger::logLevel_(MUDUO_MIN_LOG_LEVEL);
+
+
+Logger::Logger()
+    : output_(defaultOutput)
+    , flush_(defaultFlush)
+{}
+
+
 // 获取日志唯一的实例对象（懒汉式单例模式）
 Logger& Logger::instance(){
     static Logger logger;
     return logger;
 }
 
-// 设置日志级别
-void Logger::setLogLevel(int level){
-    logLevel_ = level;
+void Logger::setOutput(OutputFunc out){
+    output_ = out ? out : defaultOutput;
+}
+
+void Logger::setFlush(FlushFunc flush){
+    flush_ = flush ? flush : defaultFlush;
+}
+
+void Logger::flush(){
+    BinaryLogger::flushActive();
+    flush_.load()();
 }
 
 // 写日志   [级别信息] time : msg
-void Logger::log(std::string msg){
-    switch (logLevel_){
+void Logger::log(int level, const char* fmt, ...){
+    const char* levelName = "";
+    switch (level){
     case INFO:
-        std::cout << "[INFO]";
+        levelName = "[INFO]";
         break;
     case ERROR:
-        std::cout << "[ERROR]";
+        levelName = "[ERROR]";
         break;
     case FATAL:
-        std::cout << "[FATAL]";
+        levelName = "[FATAL]";
         break;
     case DEBUG:
-        std::cout << "[DEBUG]";
+        levelName = "[DEBUG]";
         break;
     default:
         break;
     }
 
-    // 打印时间和msg
-    std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
+    // 在栈上直接把前缀和消息格式化成一整行，不清零、不构造 std::string
+    char line[1280];
+    const size_t kMaxLen = sizeof line - 1;     // 给末尾的换行符留一个位置
+    size_t len = strlen(levelName);
+    memcpy(line, levelName, len);
+    len += Timestamp::now().formatTo(line + len, kMaxLen - len);
+    memcpy(line + len, " : ", 3);
+    len += 3;
+
+    va_list args;
+    va_start(args, fmt);
+    int m = vsnprintf(line + len, kMaxLen - len, fmt, args);
+    va_end(args);
+    if(m > 0){
+        len += static_cast<size_t>(m) < kMaxLen - len ? m : kMaxLen - len - 1;
+    }
+
+    line[len++] = '\n';
+    output_.load()(line, len);
 }
@@ -0,0 +1,196 @@
+#include "LoopWatchdog.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Timestamp.h"
+
+#include <execinfo.h>       // backtrace
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>         // free
+#include <string.h>         // memset
+#include <chrono>
+
+
+namespace {
+    const int kMaxFrames = 64;
+    const int kCaptureTimeoutMs = 100;
+
+    // 信号处理函数和 watchdog 线程之间传递调用栈，同一时刻只有一次抓取
+    void* g_frames[kMaxFrames];
+    std::atomic<pid_t> g_captureTid(0);
+    std::atomic<int> g_captureDepth(-1);
+
+    const char* phaseName(int phase){
+        return phase == EventLoop::Heartbeat::kIoCallback ? "io callback" : "pending functor";
+    }
+}
+
+
+LoopWatchdog::LoopWatchdog(int thresholdMs, int checkIntervalMs)
+    : thresholdMs_(thresholdMs)
+    , checkIntervalMs_(checkIntervalMs > 0 ? checkIntervalMs : (thresholdMs > 1 ? thresholdMs / 2 : 1))
+    , stackSignal_(0)
+    , running_(false)
+    , thread_(std::bind(&LoopWatchdog::threadFunc, this), "LoopWatchdog")
+{
+}
+
+
+LoopWatchdog::~LoopWatchdog(){
+    if(running_){
+        stop();
+    }
+}
+
+
+void LoopWatchdog::watch(EventLoop* loop){
+    std::unique_lock<std::mutex> lock(mutex_);
+    watched_.push_back(Watched{loop->enableHeartbeat(), 0});
+}
+
+
+void LoopWatchdog::enableStackCapture(int signo){
+    stackSignal_ = signo;
+}
+
+
+/*
+函数功能：
+    安装抓取调用栈的信号处理函数，开启 watchdog 线程
+其他解释：
+    glibc 的 backtrace 第一次调用时会加载 libgcc_s（会 malloc），在信号处理函数中并不安全，
+    所以先在这里调用一次，之后的调用只读栈帧
+*/
+void LoopWatchdog::start(){
+    if(stackSignal_ != 0){
+        void* warmup[1];
+        ::backtrace(warmup, 1);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof sa);
+        sa.sa_handler = &LoopWatchdog::signalHandler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        if(::sigaction(stackSignal_, &sa, nullptr) < 0){
+            LOG_ERROR("LoopWatchdog sigaction(%d) error:%d, stack capture disabled\n", stackSignal_, errno);
+            stackSignal_ = 0;
+        }
+    }
+
+    running_ = true;
+    thread_.start();
+}
+
+
+void LoopWatchdog::stop(){
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+
+void LoopWatchdog::threadFunc(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(running_){
+        cond_.wait_for(lock, std::chrono::milliseconds(checkIntervalMs_));
+        if(!running_){
+            break;
+        }
+
+        int64_t now = Timestamp::now().microSecondsSinceEpoch();
+        for(Watched& watched : watched_){
+            check(watched, now);
+        }
+    }
+}
+
+
+/*
+函数功能：
+    按顺序锁读出一致的心跳，同一个回调运行超过阈值就报告一次
+其他解释：
+    seq 为奇数说明 loop 线程正在切换回调，显然没有卡住，直接跳过
+*/
+void LoopWatchdog::check(Watched& watched, int64_t nowMicros){
+    const EventLoop::Heartbeat& hb = *watched.heartbeat;
+    uint32_t seq = hb.seq.load(std::memory_order_acquire);
+    if((seq & 1) != 0 || seq == watched.reportedSeq){
+        return;
+    }
+    int phase = hb.phase.load(std::memory_order_relaxed);
+    int fd = hb.fd.load(std::memory_order_relaxed);
+    int64_t start = hb.callbackStart.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(hb.seq.load(std::memory_order_relaxed) != seq){
+        return;
+    }
+
+    if(phase != EventLoop::Heartbeat::kIoCallback && phase != EventLoop::Heartbeat::kFunctor){
+        return;
+    }
+    int64_t elapsedMs = (nowMicros - start) / 1000;
+    if(elapsedMs < thresholdMs_){
+        return;
+    }
+
+    watched.reportedSeq = seq;
+    static metrics::Counter& stalls = metrics::MetricsRegistry::instance().counter(
+        "muduo_loop_stalls_total", "Callbacks that kept an EventLoop busy longer than the watchdog threshold");
+    stalls.inc();
+
+    LOG_ERROR("EventLoop stall: thread %d has been in %s (fd=%d) for %ld ms\n", hb.tid, phaseName(phase), fd, elapsedMs);
+    if(stackSignal_ != 0){
+        captureStack(hb.tid);
+    }
+}
+
+
+/*
+函数功能：
+    用 tgkill 让卡住的线程在信号处理函数中记录自己的调用栈，等待最多 kCaptureTimeoutMs，再在当前线程中符号化并写日志
+*/
+void LoopWatchdog::captureStack(pid_t tid){
+    g_captureDepth.store(-1, std::memory_order_relaxed);
+    g_captureTid.store(tid, std::memory_order_release);
+    if(::syscall(SYS_tgkill, ::getpid(), tid, stackSignal_) < 0){
+        g_captureTid.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    int depth = -1;
+    for(int waited = 0; waited < kCaptureTimeoutMs; ++waited){
+        depth = g_captureDepth.load(std::memory_order_acquire);
+        if(depth >= 0){
+            break;
+        }
+        ::usleep(1000);
+    }
+    g_captureTid.store(0, std::memory_order_relaxed);
+    if(depth < 0){
+        LOG_ERROR("EventLoop stall: no stack from thread %d within %d ms\n", tid, kCaptureTimeoutMs);
+        return;
+    }
+
+    char** symbols = ::backtrace_symbols(g_frames, depth);
+    // 跳过信号处理函数和信号跳板两帧
+    for(int i = 2; i < depth; ++i){
+        LOG_ERROR("    #%d %s\n", i - 2, symbols != nullptr ? symbols[i] : "?");
+    }
+    ::free(symbols);
+}
+
+
+// 只在被抓取的线程中记录栈帧，其余线程收到信号直接返回
+void LoopWatchdog::signalHandler(int){
+    int savedErrno = errno;
+    pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
+    if(tid == g_captureTid.load(std::memory_order_acquire) && g_captureDepth.load(std::memory_order_relaxed) < 0){
+        int depth = ::backtrace(g_frames, kMaxFrames);
+        g_captureDepth.store(depth, std::memory_order_release);
+    }
+    errno = savedErrno;
+}
@@ -0,0 +1,49 @@
+#include "MemoryBudget.h"
+
+
+// 获取唯一的实例对象（懒汉式单例模式）
+MemoryBudget& MemoryBudget::instance(){
+    static MemoryBudget budget;
+    return budget;
+}
+
+
+/*
+函数功能：
+    归还内存。若这次归还让 used_ 从 lowWaterMark 以上回落到以下，调用所有登记的回调
+其他解释：
+    1. 可能在任意线程中调用（Buffer 在哪个线程析构就在哪个线程），所以回调里只应该做 queueInLoop 之类的转发
+    2. 只有跨过低水位的那一次归还才加锁，平时的热路径上没有锁
+    3. 回调在锁内调用，removeRecoverCallback 拿到锁之后就不会再有该回调在执行
+*/
+void MemoryBudget::release(size_t bytes){
+    size_t prev = used_.fetch_sub(bytes, std::memory_order_relaxed);
+    if(limit() != 0){
+        size_t low = lowWaterMark();
+        if(prev > low && prev - bytes <= low){
+            std::lock_guard<std::mutex> lock(mutex_);
+            for(const std::pair<uint64_t, RecoverCallback>& item : recoverCallbacks_){
+                item.second();
+            }
+        }
+    }
+}
+
+
+uint64_t MemoryBudget::addRecoverCallback(const RecoverCallback& cb){
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t id = nextCallbackId_++;
+    recoverCallbacks_.push_back(std::make_pair(id, cb));
+    return id;
+}
+
+
+void MemoryBudget::removeRecoverCallback(uint64_t id){
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto it = recoverCallbacks_.begin(); it != recoverCallbacks_.end(); ++it){
+        if(it->first == id){
+            recoverCallbacks_.erase(it);
+            break;
+        }
+    }
+}
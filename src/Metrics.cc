@@ -0,0 +1,296 @@
+#include "Metrics.h"
+
+#include <new>          // placement new
+#include <utility>      // forward
+#include <stdlib.h>     // posix_memalign
+#include <stdio.h>
+
+
+namespace metrics{
+
+namespace {
+    std::atomic_int g_nextShard(0);
+    __thread int t_shard = -1;
+
+    // 分片按缓存行对齐，而 C++11 的 new 不保证超过 16 字节的对齐，所以手动分配
+    template <typename T, typename... Args>
+    T* createAligned(Args&&... args){
+        void* p = nullptr;
+        if(::posix_memalign(&p, 64, sizeof(T)) != 0){
+            throw std::bad_alloc();
+        }
+        return new (p) T(std::forward<Args>(args)...);
+    }
+
+    void appendValue(std::string& out, const std::string& name, const std::string& labels, const char* value){
+        out += name;
+        if(!labels.empty()){
+            out += '{';
+            out += labels;
+            out += '}';
+        }
+        out += ' ';
+        out += value;
+        out += '\n';
+    }
+
+    std::string joinLabels(const std::string& labels, const std::string& extra){
+        return labels.empty() ? extra : labels + "," + extra;
+    }
+}
+
+
+int shardIndex(){
+    if(__builtin_expect(t_shard < 0, 0)){
+        t_shard = g_nextShard.fetch_add(1, std::memory_order_relaxed) % kShards;
+    }
+    return t_shard;
+}
+
+
+uint64_t Counter::value() const{
+    uint64_t total = 0;
+    for(const Shard& shard : shards_){
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+
+Histogram::Histogram(const std::vector<double>& bounds)
+    : bounds_(bounds)
+{
+    // 每个分片的桶数组补齐到整数个缓存行，避免不同分片落在同一个缓存行
+    size_t n = (bounds_.size() + 1 + 7) / 8 * 8;
+    for(Shard& shard : shards_){
+        void* p = nullptr;
+        if(::posix_memalign(&p, 64, n * sizeof(std::atomic<uint64_t>)) != 0){
+            throw std::bad_alloc();
+        }
+        shard.buckets = static_cast<std::atomic<uint64_t>*>(p);
+        for(size_t i = 0; i < n; ++i){
+            new (&shard.buckets[i]) std::atomic<uint64_t>(0);
+        }
+    }
+}
+
+
+Histogram::~Histogram(){
+    for(Shard& shard : shards_){
+        ::free(shard.buckets);
+    }
+}
+
+
+void Histogram::observe(double v){
+    size_t i = 0;
+    while(i < bounds_.size() && v > bounds_[i]){
+        ++i;
+    }
+
+    Shard& shard = shards_[shardIndex()];
+    shard.buckets[i].fetch_add(1, std::memory_order_relaxed);
+    double old = shard.sum.load(std::memory_order_relaxed);
+    while(!shard.sum.compare_exchange_weak(old, old + v, std::memory_order_relaxed)){
+    }
+}
+
+
+std::vector<uint64_t> Histogram::bucketCounts() const{
+    std::vector<uint64_t> counts(bounds_.size() + 1, 0);
+    for(const Shard& shard : shards_){
+        for(size_t i = 0; i < counts.size(); ++i){
+            counts[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+    return counts;
+}
+
+
+double Histogram::sum() const{
+    double total = 0.0;
+    for(const Shard& shard : shards_){
+        total += shard.sum.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+
+uint64_t Histogram::count() const{
+    uint64_t total = 0;
+    for(uint64_t n : bucketCounts()){
+        total += n;
+    }
+    return total;
+}
+
+
+std::vector<double> Histogram::exponentialBounds(double start, double factor, int n){
+    std::vector<double> bounds;
+    double bound = start;
+    for(int i = 0; i < n; ++i){
+        bounds.push_back(bound);
+        bound *= factor;
+    }
+    return bounds;
+}
+
+
+// 注册表和其中的指标都不释放，见 Metrics.h
+MetricsRegistry& MetricsRegistry::instance(){
+    static MetricsRegistry* registry = new MetricsRegistry;
+    return *registry;
+}
+
+
+MetricsRegistry::Entry* MetricsRegistry::find(const std::string& name, const std::string& labels){
+    for(Entry& entry : entries_){
+        if(entry.name == name && entry.labels == labels){
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = find(name, labels);
+    if(entry == nullptr){
+        entries_.push_back(Entry{name, help, labels, kCounter, createAligned<Counter>()});
+        entry = &entries_.back();
+    }
+    return *static_cast<Counter*>(entry->metric);
+}
+
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = find(name, labels);
+    if(entry == nullptr){
+        entries_.push_back(Entry{name, help, labels, kGauge, createAligned<Gauge>()});
+        entry = &entries_.back();
+    }
+    return *static_cast<Gauge*>(entry->metric);
+}
+
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                      const std::vector<double>& bounds, const std::string& labels){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = find(name, labels);
+    if(entry == nullptr){
+        entries_.push_back(Entry{name, help, labels, kHistogram, createAligned<Histogram>(bounds)});
+        entry = &entries_.back();
+    }
+    return *static_cast<Histogram*>(entry->metric);
+}
+
+
+/*
+函数功能：
+    输出 Prometheus 文本格式。只在采集线程中读取各个分片，不影响 I/O 线程
+其他解释：
+    同名不同标签的指标只输出一次 HELP/TYPE，所以先按名字分组
+*/
+std::string MetricsRegistry::scrapePrometheus() const{
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries = entries_;
+    }
+
+    std::string out;
+    std::vector<bool> done(entries.size(), false);
+    char buf[64];
+    for(size_t i = 0; i < entries.size(); ++i){
+        if(done[i]){
+            continue;
+        }
+        const Entry& first = entries[i];
+        static const char* const kTypeNames[] = { "counter", "gauge", "histogram" };
+        out += "# HELP " + first.name + " " + first.help + "\n";
+        out += "# TYPE " + first.name + " " + kTypeNames[first.type] + "\n";
+
+        for(size_t j = i; j < entries.size(); ++j){
+            const Entry& entry = entries[j];
+            if(done[j] || entry.name != first.name){
+                continue;
+            }
+            done[j] = true;
+
+            if(entry.type == kCounter){
+                snprintf(buf, sizeof buf, "%lu", static_cast<Counter*>(entry.metric)->value());
+                appendValue(out, entry.name, entry.labels, buf);
+            }else if(entry.type == kGauge){
+                snprintf(buf, sizeof buf, "%ld", static_cast<Gauge*>(entry.metric)->value());
+                appendValue(out, entry.name, entry.labels, buf);
+            }else{
+                const Histogram* histogram = static_cast<Histogram*>(entry.metric);
+                std::vector<uint64_t> counts = histogram->bucketCounts();
+                uint64_t cumulative = 0;
+                for(size_t k = 0; k < counts.size(); ++k){
+                    cumulative += counts[k];
+                    char le[48];
+                    if(k < histogram->bounds().size()){
+                        snprintf(le, sizeof le, "le=\"%g\"", histogram->bounds()[k]);
+                    }else{
+                        snprintf(le, sizeof le, "le=\"+Inf\"");
+                    }
+                    snprintf(buf, sizeof buf, "%lu", cumulative);
+                    appendValue(out, entry.name + "_bucket", joinLabels(entry.labels, le), buf);
+                }
+                snprintf(buf, sizeof buf, "%.17g", histogram->sum());
+                appendValue(out, entry.name + "_sum", entry.labels, buf);
+                snprintf(buf, sizeof buf, "%lu", cumulative);
+                appendValue(out, entry.name + "_count", entry.labels, buf);
+            }
+        }
+    }
+    return out;
+}
+
+
+CoreMetrics::CoreMetrics()
+    : connectionsAccepted(MetricsRegistry::instance().counter(
+        "muduo_connections_accepted_total", "Connections accepted by Acceptor"))
+    , acceptErrors(MetricsRegistry::instance().counter(
+        "muduo_accept_errors_total", "accept() failures, including EMFILE"))
+    , connectionsClosed(MetricsRegistry::instance().counter(
+        "muduo_connections_closed_total", "TcpConnections closed"))
+    , connectionsActive(MetricsRegistry::instance().gauge(
+        "muduo_connections_active", "TcpConnections currently established"))
+    , bytesRead(MetricsRegistry::instance().counter(
+        "muduo_bytes_read_total", "Bytes read from connection sockets"))
+    , bytesWritten(MetricsRegistry::instance().counter(
+        "muduo_bytes_written_total", "Bytes written to connection sockets"))
+    , writeEagain(MetricsRegistry::instance().counter(
+        "muduo_write_eagain_total", "Writes that hit EAGAIN because the socket send buffer was full"))
+    , highWaterMarkHits(MetricsRegistry::instance().counter(
+        "muduo_high_water_mark_hits_total", "Times an outputBuffer crossed its high water mark"))
+    , loopIterations(MetricsRegistry::instance().counter(
+        "muduo_loop_iterations_total", "EventLoop iterations"))
+    , functorsQueued(MetricsRegistry::instance().counter(
+        "muduo_functors_queued_total", "Functors queued with queueInLoop"))
+    , wakeups(MetricsRegistry::instance().counter(
+        "muduo_loop_wakeups_total", "eventfd wakeups written to EventLoops"))
+    , functorQueueDepth(MetricsRegistry::instance().histogram(
+        "muduo_functor_queue_depth", "Functors run per doPendingFunctors call",
+        Histogram::exponentialBounds(1, 2, 12)))
+    , epollWaits(MetricsRegistry::instance().counter(
+        "muduo_epoll_wait_total", "epoll_wait calls"))
+    , epollCtls(MetricsRegistry::instance().counter(
+        "muduo_epoll_ctl_total", "epoll_ctl calls"))
+    , eventsPerWait(MetricsRegistry::instance().histogram(
+        "muduo_epoll_events_per_wait", "Ready events returned by one epoll_wait",
+        Histogram::exponentialBounds(1, 2, 12)))
+{
+}
+
+
+CoreMetrics& core(){
+    static CoreMetrics* metrics = new CoreMetrics;
+    return *metrics;
+}
+
+}   // namespace metrics
@@ -0,0 +1,139 @@
+#include "PerfCounters.h"
+#include "Logger.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+
+namespace {
+    struct EventConfig{
+        uint32_t type;
+        uint64_t config;
+    };
+
+    const EventConfig kEventConfigs[PerfCounters::kNumEvents] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    };
+
+    // 统计调用线程（pid=0）在任意 CPU 上（cpu=-1）的事件。组长创建时先不计数，整组打开后再启用
+    int openEvent(const EventConfig& cfg, int groupFd, bool excludeKernel){
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = cfg.type;
+        attr.config = cfg.config;
+        attr.disabled = groupFd < 0 ? 1 : 0;
+        attr.exclude_kernel = excludeKernel ? 1 : 0;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+    }
+}
+
+
+PerfCounters::PerfCounters(const std::string& label)
+    : leaderFd_(-1)
+    , numOpened_(0)
+{
+    memset(last_, 0, sizeof last_);
+    memset(totals_, 0, sizeof totals_);
+    memset(counters_, 0, sizeof counters_);
+
+    std::string missing;
+    bool excludeKernel = false;
+    for(int i = 0; i < kNumEvents; ++i){
+        fds_[i] = openEvent(kEventConfigs[i], leaderFd_, excludeKernel);
+        if(fds_[i] < 0 && (errno == EACCES || errno == EPERM) && !excludeKernel){
+            // perf_event_paranoid >= 2 时不允许统计内核态，改为只统计用户态，之后的事件也一样
+            excludeKernel = true;
+            fds_[i] = openEvent(kEventConfigs[i], leaderFd_, excludeKernel);
+        }
+
+        if(fds_[i] < 0){
+            missing += missing.empty() ? "" : ",";
+            missing += eventName(static_cast<Event>(i));
+            continue;
+        }
+        if(leaderFd_ < 0){
+            leaderFd_ = fds_[i];
+        }
+        order_[numOpened_++] = static_cast<Event>(i);
+    }
+
+    if(leaderFd_ < 0){
+        LOG_INFO("PerfCounters[%s]: perf_event_open not permitted or unsupported (errno %d), disabled\n", label.c_str(), errno);
+        return;
+    }
+    if(!missing.empty()){
+        LOG_INFO("PerfCounters[%s]: unavailable events: %s\n", label.c_str(), missing.c_str());
+    }
+
+    for(int p = 0; p < kNumPhases; ++p){
+        for(int i = 0; i < numOpened_; ++i){
+            Event e = order_[i];
+            counters_[p][e] = &metrics::MetricsRegistry::instance().counter(
+                "muduo_loop_perf_events_total", "perf_event counts of each EventLoop, by loop phase",
+                "loop=\"" + label + "\",phase=\"" + phaseName(static_cast<Phase>(p)) + "\",event=\"" + eventName(e) + "\"");
+        }
+    }
+
+    ::ioctl(leaderFd_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    read(last_);
+}
+
+
+PerfCounters::~PerfCounters(){
+    for(int fd : fds_){
+        if(fd >= 0){
+            ::close(fd);
+        }
+    }
+}
+
+
+void PerfCounters::endPhase(Phase phase){
+    uint64_t now[kNumEvents];
+    if(!read(now)){
+        return;
+    }
+    for(int i = 0; i < numOpened_; ++i){
+        Event e = order_[i];
+        uint64_t delta = now[e] - last_[e];
+        last_[e] = now[e];
+        totals_[phase][e] += delta;
+        counters_[phase][e]->inc(delta);
+    }
+}
+
+
+// PERF_FORMAT_GROUP 的格式为 { u64 nr; u64 values[nr]; }，values 按打开的顺序排列
+bool PerfCounters::read(uint64_t* values){
+    uint64_t buf[1 + kNumEvents];
+    ssize_t n = ::read(leaderFd_, buf, sizeof buf);
+    if(n < static_cast<ssize_t>(sizeof(uint64_t) * (1 + numOpened_))){
+        return false;
+    }
+    for(int i = 0; i < numOpened_; ++i){
+        values[order_[i]] = buf[1 + i];
+    }
+    return true;
+}
+
+
+const char* PerfCounters::eventName(Event e){
+    static const char* const kNames[kNumEvents] = { "cycles", "instructions", "cache_misses", "context_switches" };
+    return kNames[e];
+}
+
+
+const char* PerfCounters::phaseName(Phase phase){
+    static const char* const kNames[kNumPhases] = { "poll", "io", "functors" };
+    return kNames[phase];
+}
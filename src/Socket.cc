@@ -7,6 +7,7 @@
 #include <sys/socket.h>     // bind等
 #include <string.h>         // memset
 #include <netinet/tcp.h>    // TCP_NODELAY
+#include <linux/net_tstamp.h> // SOF_TIMESTAMPING_*
 
 
 Socket::~Socket(){
@@ -110,3 +111,34 @@ void Socket::setKeepAlive(bool on){
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, static_cast<socklen_t>(sizeof optval));
 }
 
+
+
+/*
+函数功能：
+    开启 SO_ZEROCOPY，之后该socket上才允许使用 send(..., MSG_ZEROCOPY)
+其他解释：
+    需要 linux 4.14 以上内核，老内核会返回 ENOPROTOOPT，此时返回false，调用方退回普通的拷贝发送
+*/
+bool Socket::setZeroCopy(bool on){
+    int optval = on ? 1 : 0;
+    if(::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, static_cast<socklen_t>(sizeof optval)) < 0){
+        LOG_ERROR("setZeroCopy sockfd_:%d error:%d\n", sockfd_, errno);
+        return false;
+    }
+    return true;
+}
+
+
+bool Socket::setRxTimestamp(bool on){
+    int flags = on ? (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE) : 0;
+    if(::setsockopt(sockfd_, SOL_SOCKET, SO_TIMESTAMPING, &flags, static_cast<socklen_t>(sizeof flags)) == 0){
+        return true;
+    }
+
+    int optval = on ? 1 : 0;
+    if(::setsockopt(sockfd_, SOL_SOCKET, SO_TIMESTAMPNS, &optval, static_cast<socklen_t>(sizeof optval)) < 0){
+        LOG_ERROR("setRxTimestamp sockfd_:%d error:%d\n", sockfd_, errno);
+        return false;
+    }
+    return true;
+}
@@ -3,16 +3,35 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "Probes.h"
+#include "AllocTracker.h"
 
 #include <functional>
 #include <unistd.h>         // close
 #include <sys/types.h>      // bind等
 #include <sys/socket.h>     // bind等
 #include <string.h>         // memset
+#include <stdio.h>          // snprintf
 #include <netinet/tcp.h>    // TCP_NODELAY
+#include <netinet/in.h>     // IP_RECVERR
+#include <linux/errqueue.h> // sock_extended_err
 #include <string>
 
 
+// 读空的缓冲区容量超过该值（或者内存预算紧张）时，把内存还回去
+static const size_t kIdleBufferShrinkSize = 1024*1024;
+
+
+// 没有设置任何回调的连接共享的空回调集合，保证 callbacks_ 永远不为空
+static const ConnectionCallbacksPtr& emptyCallbacks(){
+    static const ConnectionCallbacksPtr empty = std::make_shared<ConnectionCallbacks>();
+    return empty;
+}
+
+
 static EventLoop* CheckLoopNotNull(EventLoop* loop){
     if (loop == nullptr){
         LOG_FATAL("mainLoop is null! errno:%d \n", errno);
@@ -23,52 +42,143 @@ static EventLoop* CheckLoopNotNull(EventLoop* loop){
 
 
 TcpConnection::TcpConnection(EventLoop *loop, 
-                const std::string& nameArg, 
+                uint64_t id,
+                const std::shared_ptr<const std::string>& namePrefix,
                 int sockfd,
                 const InetAddress& localAddr,
                 const InetAddress& peerAddr)
     : loop_( CheckLoopNotNull(loop) )
-    , name_( nameArg )
+    , id_(id)
+    , namePrefix_(namePrefix)
     , state_(kConnecting)
     , reading_(true)
-    , socket_( new Socket(sockfd) )
-    , channel_( new Channel(loop, sockfd) )
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
+    , callbacks_(emptyCallbacks())
     , highWaterMark_(64*1024*1024) // 64M，防止发送太快，而接受太慢
+    , pauseReadMark_(0)
+    , resumeReadMark_(0)
+    , readPausedByFlowControl_(false)
+    , readPausedByBudget_(false)
+    , bufferBytes_(0)
+    , inputBuffer_(0)
+    , outputBuffer_(0)
+    , rxTimestamp_(false)
+    , autoCork_(false)
+    , corkFlushQueued_(false)
+    , zeroCopy_(false)
+    , zeroCopyThreshold_(kDefaultZeroCopyThreshold)
+    , zeroCopySeq_(0)
+    , traceId_(0)
 {
     // 给channel设置回调函数，poller监听到感兴趣事件发生时候所执行的函数
-    channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    // 只捕获 this 的 lambda 能放进 std::function 的内部存储，std::bind 的结果放不下，每个回调都要多一次堆分配
+    channel_.setReadCallback([this](Timestamp receiveTime){ handleRead(receiveTime); });
+    channel_.setWriteCallback([this](){ handleWrite(); });
+    channel_.setCloseCallback([this](){ handleClose(); });
+    channel_.setErrorCallback([this](){ handleError(); });
+
+    inputBuffer_.setMemoryCounter(&bufferBytes_);
+    outputBuffer_.setMemoryCounter(&bufferBytes_);
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd = %d", name_.c_str(), channel_->getFd());
-    socket_->setKeepAlive(true);    // 启动保活机制，保持长连接
+    LOG_DEBUG("TcpConnection::ctor[%s] at fd = %d", getName().c_str(), channel_.getFd());
+    socket_.setKeepAlive(true);    // 启动保活机制，保持长连接
 }
 
 
 
 TcpConnection::~TcpConnection(){
-    LOG_INFO("TcpConnection::dtor[%s] at fd = %d state=%d\n", 
-                name_.c_str(), channel_->getFd(), (int)state_);
+    LOG_DEBUG("TcpConnection::dtor[%s] at fd = %d state=%d\n", 
+                getName().c_str(), channel_.getFd(), (int)state_);
+}
+
+
+std::string TcpConnection::getName() const{
+    // id 的低 32 位是槽位下标，高 32 位是代数，格式化成 "#下标.代数"
+    char buf[32];
+    snprintf(buf, sizeof buf, "#%u.%u", static_cast<uint32_t>(id_), static_cast<uint32_t>(id_ >> 32));
+    return namePrefix_ ? *namePrefix_ + buf : std::string("TcpConnection") + buf;
 }
 
 
 
+void TcpConnection::setTcpNoDelay(bool on){
+    socket_.setTcpNoDelay(on);
+}
+
+
 // 向客户端发送数据
 void TcpConnection::send(const std::string& buf){
-    if(state_ == StateE::kConnected){
+    send(buf.data(), buf.size());
+}
+
+
+void TcpConnection::send(const void* data, size_t len){
+    if(state_ == kConnected){
         if(loop_->isInLoopThread()){
-            sendInLoop(buf.c_str(), buf.size());
+            // 借用的数据不走零拷贝：为了保活要先拷贝一份，反而比普通 send 多一次分配和拷贝。直接写，剩下的进入 outputBuffer_
+            sendInLoop(data, len);
+        }else{
+            // 跨线程时，调用方的数据在返回后就可能失效，只能拷贝一份
+            MUDUO_ALLOC_SITE("TcpConnection::send(copy)");
+            std::shared_ptr<std::string> payload = std::make_shared<std::string>(static_cast<const char*>(data), len);
+            sendOwned(payload, payload->data(), payload->size());
+        }
+    }
+}
+
+
+void TcpConnection::send(std::string&& buf){
+    if(state_ == kConnected){
+        if(loop_->isInLoopThread() && !useZeroCopy(buf.size())){
+            sendInLoop(buf.data(), buf.size());
+        }else{
+            MUDUO_ALLOC_SITE("TcpConnection::send(copy)");
+            std::shared_ptr<std::string> payload = std::make_shared<std::string>(std::move(buf));
+            sendOwned(payload, payload->data(), payload->size());
+        }
+    }
+}
+
+
+void TcpConnection::send(Buffer* buf){
+    if(state_ == kConnected){
+        if(loop_->isInLoopThread() && !useZeroCopy(buf->readableBytes())){
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retriveAll();
         }else{
-            loop_->runInLoop(
-                std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));     // 绑定的是 this->sendInLoop
+            // 交换底层的存储，把数据的所有权转移给loop的任务
+            MUDUO_ALLOC_SITE("TcpConnection::send(copy)");
+            std::shared_ptr<Buffer> owned = std::make_shared<Buffer>(0);
+            owned->swap(*buf);
+            sendOwned(owned, owned->peek(), owned->readableBytes());
         }
     }
 }
 
 
+void TcpConnection::send(const std::shared_ptr<const std::string>& payload){
+    if(state_ == kConnected){
+        sendOwned(payload, payload->data(), payload->size());
+    }
+}
+
+
+void TcpConnection::sendOwned(const std::shared_ptr<const void>& owner, const char* data, size_t len){
+    if(loop_->isInLoopThread()){
+        sendOwnedInLoop(owner, data, len);
+    }else{
+        // 绑定 shared_from_this()，保证任务执行时 TcpConnection 依然存活
+        TraceSpan span("TcpConnection::send", traceId_);
+        MUDUO_ALLOC_SITE("TcpConnection::sendOwned");
+        loop_->runInLoop(Tracer::hop("TcpConnection::sendOwnedInLoop", traceId_,
+            std::bind(&TcpConnection::sendOwnedInLoop, shared_from_this(), owner, data, len)));
+    }
+}
+
+
 
 /*
     上层调用 shutdown时，关闭socket_的写端，poller会给channel通知关闭事件，
@@ -86,6 +196,8 @@ void TcpConnection::shutdown(){
 
 // 发送数据  应用写的快  而内核发送数据慢，需要把待发送数据写入缓冲区，而且设置水位回调
 void TcpConnection::sendInLoop(const void* data, size_t len){
+    TraceSpan span("TcpConnection::sendInLoop", traceId_);
+    MUDUO_ALLOC_SITE("TcpConnection::sendInLoop");
     ssize_t nwrote = 0;
     ssize_t remaining = len;
     bool faultError = false;
@@ -96,20 +208,24 @@ void TcpConnection::sendInLoop(const void* data, size_t len){
         return;
     }
 
-    // channel_ 第一次开始写数据，而且缓冲区没有待发送数据
-    if( !channel_->isWriting() && outputBuffer_.readableBytes() == 0 ){
-        nwrote = ::write(channel_->getFd(), data, len);
+    // channel_ 第一次开始写数据，而且缓冲区没有待发送数据（自动合并模式下先不写，攒到本轮循环结束）
+    if( !autoCork_ && !channel_.isWriting() && outputBuffer_.readableBytes() == 0 ){
+        nwrote = ::write(channel_.getFd(), data, len);
+        MUDUO_PROBE3(conn_write, loop_, channel_.getFd(), nwrote);
         if(nwrote >= 0){
+            metrics::core().bytesWritten.inc(nwrote);
             remaining = len - nwrote;
 
-            if(remaining == 0 && writeCompleteCallback_){
+            if(remaining == 0 && callbacks_->writeComplete){
                 // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
                 loop_->queueInLoop(
-                    std::bind(&TcpConnection::writeCompleteCallback_, shared_from_this()));
+                    std::bind(callbacks_->writeComplete, shared_from_this()));
             }
         }else{  // nwrote < 0
             nwrote = 0;
-            if (errno != EWOULDBLOCK){
+            if(errno == EWOULDBLOCK){
+                metrics::core().writeEagain.inc();
+            }else{
                 LOG_ERROR("errno:%d\n", errno);
                 if(errno == EPIPE || errno == ECONNRESET){  // SIGPIPE  RESET
                     faultError = true;
@@ -123,16 +239,377 @@ void TcpConnection::sendInLoop(const void* data, size_t len){
     // 也就是调用TcpConnection::handleWrite方法，把发送缓冲区中的数据全部发送完成
     if(!faultError && remaining > 0){
         size_t oldLen = outputBuffer_.readableBytes();  // 目前发送缓冲区剩余的待发送数据的长度
-        if(oldLen < highWaterMark_ 
-            && oldLen + remaining >= highWaterMark_
-            && highWaterMarkCallback_)
-        {
-            // 调用水位线回调
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));    
+        if(oldLen < highWaterMark_ && oldLen + remaining >= highWaterMark_){
+            metrics::core().highWaterMarkHits.inc();
+            if(callbacks_->highWaterMark){
+                // 调用水位线回调
+                loop_->queueInLoop(std::bind(callbacks_->highWaterMark, shared_from_this(), oldLen + remaining));
+            }
         }
         outputBuffer_.append((char*) data + nwrote, remaining);
-        if(!channel_->isWriting()){
-            channel_->enableWriting();      // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout事件
+        checkReadFlowControl();
+        checkMemoryBudget();
+        if(channel_.isWriting()){
+            return;                         // 已经在等待 epollout 了，handleWrite 会一并发出
+        }
+
+        if(autoCork_){
+            // 在本轮的 doPendingFunctors 中统一 flush。loop线程中 queueInLoop 不会唤醒 poll
+            if(!corkFlushQueued_){
+                corkFlushQueued_ = true;
+                loop_->queueInLoop(
+                    std::bind(&TcpConnection::flushInLoop, shared_from_this()));
+            }
+        }else{
+            channel_.enableWriting();      // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout事件
+        }
+    }
+}
+
+
+/*
+函数功能：
+    把 outputBuffer_ 中攒下的数据用一次系统调用写出去，写不完的部分交给 epollout 继续发送
+其他解释：
+    1. 自动合并模式下由本轮循环末尾的任务调用；也可以通过 flush() 立即发送
+    2. channel 已经在等待 epollout 时什么也不做，handleWrite 会继续发送
+*/
+void TcpConnection::flushInLoop(){
+    corkFlushQueued_ = false;
+    if(state_ == kDisconnected || channel_.isWriting() || outputBuffer_.readableBytes() == 0){
+        return;
+    }
+
+    int savedErrno = 0;
+    ssize_t n = outputBuffer_.writeFd(channel_.getFd(), &savedErrno);
+    MUDUO_PROBE3(conn_write, loop_, channel_.getFd(), n);
+    if(n > 0){
+        metrics::core().bytesWritten.inc(n);
+        outputBuffer_.retrive(n);
+        checkReadFlowControl();
+    }else if(n < 0 && savedErrno == EWOULDBLOCK){
+        metrics::core().writeEagain.inc();
+    }else if(n < 0){
+        LOG_ERROR("errno:%d\n", savedErrno);
+        if(savedErrno == EPIPE || savedErrno == ECONNRESET){
+            return;
+        }
+    }
+
+    if(outputBuffer_.readableBytes() > 0){
+        channel_.enableWriting();
+    }else if(callbacks_->writeComplete){
+        loop_->queueInLoop(
+            std::bind(callbacks_->writeComplete, shared_from_this()));
+    }
+}
+
+
+// 自动合并模式下，对延迟敏感的场景可以调用 flush 立即发送已经攒下的数据
+void TcpConnection::flush(){
+    if(state_ == kConnected || state_ == kDisconnecting){
+        loop_->runInLoop(
+            std::bind(&TcpConnection::flushInLoop, shared_from_this()));
+    }
+}
+
+
+void TcpConnection::setTimestampedMessageCallback(const TimestampedMessageCallback& cb){
+    mutableCallbacks().timestampedMessage = cb;
+    rxTimestamp_ = cb && socket_.setRxTimestamp(true);
+}
+
+
+void TcpConnection::setCallbacks(const ConnectionCallbacksPtr& callbacks){
+    callbacks_ = callbacks ? callbacks : emptyCallbacks();
+    rxTimestamp_ = callbacks_->timestampedMessage && socket_.setRxTimestamp(true);
+}
+
+
+/*
+函数功能：
+    返回本连接私有的回调集合，供 setXxxCallback 修改
+其他解释：
+    1. 只有本连接引用时直接修改（对象本身不是 const 创建的），否则先复制一份，不影响共享它的其他连接（包括共享的空集合）
+    2. 用户回调中可能会调用 setXxxCallback，调用用户回调的地方要先持有一份 callbacks_，防止正在执行的回调被释放
+*/
+ConnectionCallbacks& TcpConnection::mutableCallbacks(){
+    if(callbacks_.use_count() > 1){
+        callbacks_ = std::make_shared<ConnectionCallbacks>(*callbacks_);
+    }
+    return const_cast<ConnectionCallbacks&>(*callbacks_);
+}
+
+
+/*
+函数功能：
+    开启/关闭大数据的 MSG_ZEROCOPY 发送
+其他解释：
+    1. 内核不支持 SO_ZEROCOPY 时，保持普通的拷贝发送
+    2. 关闭后，已经发出的零拷贝数据依然要等完成通知才会释放
+*/
+void TcpConnection::setZeroCopy(bool on, size_t threshold){
+    zeroCopyThreshold_ = threshold;
+    if(on && !socket_.setZeroCopy(true)){
+        on = false;
+    }
+    if(on && !zeroCopyPending_){
+        zeroCopyPending_.reset(new std::deque<ZeroCopyPayload>());
+    }
+    zeroCopy_ = on;
+}
+
+
+/*
+函数功能：
+    发送 owner 持有的数据。达到零拷贝阈值时以 MSG_ZEROCOPY 的方式发送，owner 会一直被持有，直到内核通过错误队列通知完成
+其他解释：
+    1. 未开启零拷贝、数据较小，或 outputBuffer_ 中还有待发送数据（不能插队）时，走普通的 sendInLoop
+    2. 一次 send 只发出了一部分时，剩余部分走普通路径进入 outputBuffer_，已发出的部分依然等待完成通知
+    3. ENOBUFS 表示超过了 optmem_max 的限制，同样退回普通路径
+*/
+void TcpConnection::sendOwnedInLoop(const std::shared_ptr<const void>& owner, const char* data, size_t len){
+    if(state_ == kDisconnected){
+        LOG_ERROR("disconnecting, give up writing, errno:%d\n", errno);
+        return;
+    }
+
+    if(useZeroCopy(len) && corkFlushQueued_){
+        flushInLoop();      // 先把攒下的小数据发出去，大数据才有机会走零拷贝
+    }
+
+    if(!useZeroCopy(len) || channel_.isWriting() || outputBuffer_.readableBytes() > 0){
+        sendInLoop(data, len);
+        return;
+    }
+
+    ssize_t nwrote = ::send(channel_.getFd(), data, len, MSG_ZEROCOPY);
+    MUDUO_PROBE3(conn_write, loop_, channel_.getFd(), nwrote);
+    if(nwrote <= 0){
+        sendInLoop(data, len);
+        return;
+    }
+
+    metrics::core().bytesWritten.inc(nwrote);
+    // 每一次成功的 MSG_ZEROCOPY 调用都会占用一个序号，内核按序号区间通知完成情况
+    zeroCopyPending_->emplace_back(zeroCopySeq_++, owner);
+
+    size_t remaining = len - nwrote;
+    if(remaining > 0){
+        sendInLoop(data + nwrote, remaining);
+    }else if(callbacks_->writeComplete){
+        loop_->queueInLoop(
+            std::bind(callbacks_->writeComplete, shared_from_this()));
+    }
+}
+
+
+/*
+函数功能：
+    读空 socket 的错误队列，释放内核已经发送完成的零拷贝数据。返回是否读到了零拷贝完成通知
+其他解释：
+    1. 完成通知是一个序号闭区间 [ee_info, ee_data]，可能合并了多次 send
+    2. SO_EE_CODE_ZEROCOPY_COPIED 表示内核最终还是做了拷贝（比如回环网卡），继续零拷贝只有额外开销，所以关闭
+*/
+bool TcpConnection::handleZeroCopyCompletion(){
+    bool handled = false;
+    char control[128];
+
+    for(;;){
+        msghdr msg;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if(::recvmsg(channel_.getFd(), &msg, MSG_ERRQUEUE) < 0){
+            break;      // EAGAIN，错误队列已经读空
+        }
+
+        for(cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)){
+            if( !(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) 
+                && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR) ){
+                continue;
+            }
+
+            const sock_extended_err* serr = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if(serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY){
+                continue;
+            }
+
+            uint32_t lo = serr->ee_info;
+            uint32_t hi = serr->ee_data;
+            for(ZeroCopyPayload& item : *zeroCopyPending_){
+                if(item.first - lo <= hi - lo){     // 无符号减法，兼容序号回绕
+                    item.second.reset();
+                }
+            }
+            if(serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED){
+                zeroCopy_ = false;
+            }
+            handled = true;
+        }
+    }
+
+    // 完成通知基本是按序到达的，从队头开始释放
+    while(!zeroCopyPending_->empty() && !zeroCopyPending_->front().second){
+        zeroCopyPending_->pop_front();
+    }
+
+    return handled;
+}
+
+
+/*
+    缓冲区增长后检查全局内存预算，超出时交给 TcpServer 按策略处理（暂停读、踢掉最大的连接、关闭连接）
+*/
+void TcpConnection::checkMemoryBudget(){
+    if(callbacks_->memoryBudget && MemoryBudget::instance().exceeded()){
+        ConnectionCallbacksPtr callbacks(callbacks_);
+        callbacks->memoryBudget(shared_from_this());
+    }
+}
+
+
+// 缓冲区读空后，占用过大或者内存预算紧张时，收缩回初始大小
+static void shrinkIfIdle(Buffer* buf){
+    if(buf->readableBytes() == 0
+        && buf->internalCapacity() > Buffer::kCheapPrepend + Buffer::kInitialSize
+        && (buf->internalCapacity() > kIdleBufferShrinkSize || MemoryBudget::instance().exceeded()))
+    {
+        buf->shrink(Buffer::kInitialSize);
+    }
+}
+
+
+/*
+    强制关闭：不等待 outputBuffer_ 发送完成。
+    放到队列中执行，避免在 handleRead 等回调的中途就把连接关掉
+*/
+void TcpConnection::forceClose(){
+    if(state_ == kConnected || state_ == kDisconnecting){
+        setState(kDisconnecting);
+        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+
+void TcpConnection::forceCloseInLoop(){
+    if(state_ == kConnected || state_ == kDisconnecting){
+        handleClose();
+    }
+}
+
+
+// 恢复读：重新向poller注册 EPOLLIN
+void TcpConnection::startRead(){
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+
+/*
+    暂停读：从poller中去掉 EPOLLIN，数据留在内核的接收缓冲区里，
+    接收窗口被填满后对端自然就发不过来了，inputBuffer_ 也不会再增长
+*/
+void TcpConnection::stopRead(){
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+
+// 内存预算暂停读。在超预算的连接所在的subloop中调用
+void TcpConnection::pauseReadForBudget(){
+    loop_->runInLoop(std::bind(&TcpConnection::pauseReadForBudgetInLoop, shared_from_this()));
+}
+
+
+// 内存回落后恢复读，由 TcpServer 在 baseloop 中调用
+void TcpConnection::resumeReadForBudget(){
+    loop_->runInLoop(std::bind(&TcpConnection::resumeReadForBudgetInLoop, shared_from_this()));
+}
+
+
+void TcpConnection::startReadInLoop(){
+    readPausedByFlowControl_ = false;       // 用户显式恢复后，不再由水位线和内存预算自动管理
+    readPausedByBudget_ = false;
+    enableReadInLoop();
+}
+
+
+void TcpConnection::stopReadInLoop(){
+    readPausedByFlowControl_ = false;
+    readPausedByBudget_ = false;
+    disableReadInLoop();
+}
+
+
+void TcpConnection::enableReadInLoop(){
+    if(state_ == kDisconnected || state_ == kConnecting){
+        return;                             // 已关闭的channel不能再注册到poller上
+    }
+    if(!reading_ || !channel_.isReading()){
+        channel_.enableReading();
+        reading_ = true;
+    }
+}
+
+
+void TcpConnection::disableReadInLoop(){
+    if(state_ == kDisconnected || state_ == kConnecting){
+        return;                             // 已关闭的channel已经从poller中删除，disableReading 会把它重新注册回去
+    }
+    if(reading_ || channel_.isReading()){
+        channel_.disableReading();
+        reading_ = false;
+    }
+}
+
+
+void TcpConnection::pauseReadForBudgetInLoop(){
+    if(reading_){
+        disableReadInLoop();
+        readPausedByBudget_ = true;
+    }
+}
+
+
+// 只恢复由内存预算暂停的读；读流控仍在暂停时交给 checkReadFlowControl 在输出缓冲区降下来后恢复
+void TcpConnection::resumeReadForBudgetInLoop(){
+    if(!readPausedByBudget_){
+        return;
+    }
+    readPausedByBudget_ = false;
+    if(!readPausedByFlowControl_){
+        enableReadInLoop();
+    }
+}
+
+
+// 设置 outputBuffer_ 的读流控水位线，highWaterMark 为 0 表示关闭
+void TcpConnection::setReadFlowControl(size_t highWaterMark, size_t lowWaterMark){
+    pauseReadMark_ = highWaterMark;
+    resumeReadMark_ = lowWaterMark < highWaterMark ? lowWaterMark : highWaterMark / 2;
+}
+
+
+/*
+函数功能：
+    outputBuffer_ 变化后检查读流控：
+        超过 pauseReadMark_ 暂停读，对端发得快、我们发得慢时，不再继续接收新的请求
+        降到 resumeReadMark_ 以下时，恢复由流控暂停的读（用户自己 stopRead 的、内存预算仍在暂停的不会被恢复）
+*/
+void TcpConnection::checkReadFlowControl(){
+    if(pauseReadMark_ == 0){
+        return;
+    }
+
+    size_t pending = outputBuffer_.readableBytes();
+    if(!readPausedByFlowControl_){
+        if((reading_ || readPausedByBudget_) && pending >= pauseReadMark_){
+            disableReadInLoop();
+            readPausedByFlowControl_ = true;
+        }
+    }else if(pending <= resumeReadMark_){
+        readPausedByFlowControl_ = false;
+        if(!readPausedByBudget_){
+            enableReadInLoop();
         }
     }
 }
@@ -144,39 +621,77 @@ void TcpConnection::connectEstablished(){
     // shared_from_this() 表示从一个对象内部获取指向该对象的 shared_ptr 实例
     // channel的回调函数是TcpConnection注册的。当TcpConnection析构时，channel对应的回调函数还执行么？
     // 解决办法：通过弱智能指针的提升，来检测TcpConnection对象是否还存活
-    channel_->setTie(shared_from_this());       // 使用弱智能指针，TcpConnection对象被remove后，依然执行channel_对应的回调
-    channel_->enableReading();                  // 向poller注册channel的eventin事件
-
-    // 新连接建立，执行新连接建立回调
-    connectionCallback_(shared_from_this());
+    channel_.setTie(shared_from_this());       // 使用弱智能指针，TcpConnection对象被remove后，依然执行channel_对应的回调
+    channel_.enableReading();                  // 向poller注册channel的eventin事件
+    MUDUO_PROBE2(conn_established, loop_, channel_.getFd());
+    metrics::core().connectionsActive.add(1);
+
+    // 新连接建立，执行新连接建立回调。用户通常在这里调用 setXxxCallback，见 mutableCallbacks
+    ConnectionCallbacksPtr callbacks(callbacks_);
+    callbacks->connection(shared_from_this());
 }
 
 
 // 连接销毁 
 void TcpConnection::connectDestroyed(){
+    MUDUO_PROBE2(conn_destroyed, loop_, channel_.getFd());
     if(state_ == kConnected){
         setState(kDisconnected);
-        channel_->disableAll();     // 把channel所有感兴趣的事件，从poller中del掉
-        connectionCallback_(shared_from_this());
+        channel_.disableAll();     // 把channel所有感兴趣的事件，从poller中del掉
+        reading_ = false;
+        ConnectionCallbacksPtr callbacks(callbacks_);
+        callbacks->connection(shared_from_this());
     }
-    channel_->remove();             // 把channel从poller中删除掉
+    channel_.remove();             // 把channel从poller中删除掉
+    metrics::core().connectionsActive.sub(1);
+    metrics::core().connectionsClosed.inc();
 }
 
 
 void TcpConnection::shutdownInLoop(){
-    if(!channel_->isWriting()){     // 当前outputBuffer_中的数据已经发送完成
-        socket_->shutdownWrite();   // 关闭写端
+    if(!channel_.isWriting() && outputBuffer_.readableBytes() > 0){
+        flushInLoop();              // 自动合并模式下还有没写出去的数据，先发送
+    }
+
+    if(!channel_.isWriting()){     // 当前outputBuffer_中的数据已经发送完成
+        socket_.shutdownWrite();   // 关闭写端
     }
 }
 
 
 // 调用读事件回调。
 void TcpConnection::handleRead(Timestamp receiveTime){
+    TraceSpan span("TcpConnection::handleRead", traceId_);
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->getFd(), &savedErrno);
+    ssize_t n = 0;
+    if(rxTimestamp_){
+        // 一条消息可能分几次读到，只记录 inputBuffer_ 为空之后第一次读到的时间，即这批数据最早的到达时间
+        Timestamp kernelTime;
+        n = inputBuffer_.readFdWithTimestamp(channel_.getFd(), &savedErrno, &kernelTime);
+        if(n > 0 && !firstArrival_.valid()){
+            firstArrival_ = kernelTime.valid() ? kernelTime : receiveTime;
+        }
+    }else{
+        n = inputBuffer_.readFd(channel_.getFd(), &savedErrno);
+    }
+    MUDUO_PROBE3(conn_read, loop_, channel_.getFd(), n);
+
     if(n > 0){
+        metrics::core().bytesRead.inc(n);
+        checkMemoryBudget();
+        TraceSpan callbackSpan("MessageCallback", traceId_);
         // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作 onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);   // shared_from_this() 表示获取当前 TcpConnection 对象的智能指针。将connection给他的原因是，他还需要用connection发送数据
+        // 先持有一份回调集合，onMessage 中调用 setXxxCallback 时不会修改或释放正在执行的回调，见 mutableCallbacks
+        ConnectionCallbacksPtr callbacks(callbacks_);
+        if(callbacks->timestampedMessage){
+            callbacks->timestampedMessage(shared_from_this(), &inputBuffer_, receiveTime, firstArrival_);
+            if(inputBuffer_.readableBytes() == 0){
+                firstArrival_ = Timestamp::invalid();
+            }
+        }else{
+            callbacks->message(shared_from_this(), &inputBuffer_, receiveTime);   // shared_from_this() 表示获取当前 TcpConnection 对象的智能指针。将connection给他的原因是，他还需要用connection发送数据
+        }
+        shrinkIfIdle(&inputBuffer_);
     }else if(n == 0){
         // 对方关闭连接
         handleClose();
@@ -191,55 +706,72 @@ void TcpConnection::handleRead(Timestamp receiveTime){
 
 // 调用写事件回调
 void TcpConnection::handleWrite(){
-    if(channel_->isWriting()){
+    TraceSpan span("TcpConnection::handleWrite", traceId_);
+    MUDUO_ALLOC_SITE("TcpConnection::handleWrite");
+    if(channel_.isWriting()){
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->getFd(), &savedErrno);
+        ssize_t n = outputBuffer_.writeFd(channel_.getFd(), &savedErrno);
+        MUDUO_PROBE3(conn_write, loop_, channel_.getFd(), n);
         if(n > 0){
+            metrics::core().bytesWritten.inc(n);
             outputBuffer_.retrive(n);
+            checkReadFlowControl();
             if(outputBuffer_.readableBytes() == 0){
-                channel_->disableWriting();
-                if(writeCompleteCallback_){
+                channel_.disableWriting();
+                shrinkIfIdle(&outputBuffer_);
+                if(callbacks_->writeComplete){
                     // 唤醒 loop_ 对应的线程，执行回调
                     loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
+                        std::bind(callbacks_->writeComplete, shared_from_this())
                     );
                 }
                 if(state_ == kDisconnecting){
                     shutdownInLoop();
                 }
             }
+        }else if(savedErrno == EWOULDBLOCK){
+            metrics::core().writeEagain.inc();
         }else{
-            LOG_ERROR("errno:%d\n", errno);
+            LOG_ERROR("errno:%d\n", savedErrno);
         }
     }else{
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing\n", channel_->getFd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing\n", channel_.getFd());
     }
 }
 
 
 // poller => channel::closeCallback => TcpConnection::handClose
 void TcpConnection::handleClose(){
-    LOG_INFO("fd=%d state=%d\n", channel_->getFd(), (int)state_);
+    LOG_DEBUG("fd=%d state=%d\n", channel_.getFd(), (int)state_);
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
+    reading_ = false;
 
     TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr);   // 执行连接关闭时的回调
-    closeCallback_(connPtr);        // 执行关闭连接回调 执行的是TcpServer::removeConnection回调方法
+    ConnectionCallbacksPtr callbacks(callbacks_);
+    callbacks->connection(connPtr);   // 执行连接关闭时的回调
+    callbacks->close(connPtr);        // 执行关闭连接回调 执行的是TcpServer::removeConnection回调方法
 }
 
 
 // 调用错误事件回调
 void TcpConnection::handleError(){
+    // 零拷贝的完成通知也是通过错误队列上报的，poller 同样报告 EPOLLERR
+    bool zeroCopyNotified = zeroCopyPending_ && !zeroCopyPending_->empty() && handleZeroCopyCompletion();
+
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if(::getsockopt(channel_->getFd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0){
+    if(::getsockopt(channel_.getFd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0){
         err = errno;
     }else{
         err = optval;
     }
 
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d", name_.c_str(), err);
+    if(zeroCopyNotified && err == 0){
+        return;
+    }
+
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d", getName().c_str(), err);
 }
 
@@ -1,8 +1,12 @@
 #include "TcpServer.h"
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "MemoryBudget.h"
+#include "Tracer.h"
+#include "AllocTracker.h"
 
 #include <functional>   // placeholders 命名空间
+#include <algorithm>    // partial_sort
 #include <string.h>     // memset、bzero
 
 
@@ -31,12 +35,19 @@ TcpServer::TcpServer(EventLoop* loop, const InetAddress& listenAddr, const std::
     : loop_(CheckLoopNotNull(loop))     // baseloop
     , ipPort_(listenAddr.toIpPort())
     , name_(nameArg)
+    , connNamePrefix_(std::make_shared<const std::string>(nameArg + "-" + ipPort_))
     , acceptor_( new Acceptor(loop, listenAddr, option == kReusePort) )   
     , threadPool_(new EventLoopThreadPool(loop, name_)) 
     , connectionCallback_()
     , messageCallback_()
-    , nextConnId_(1)
+    , highWaterMark_(64*1024*1024)
+    , pauseReadMark_(0)
+    , resumeReadMark_(0)
     , started_(0)
+    , budgetEnabled_(false)
+    , budgetSubscription_(0)
+    , budgetPolicy_(kStopReading)
+    , shedQueued_(false)
 {
     // 绑定回调 acceptor_ 的新用户连接回调。当有新用户连接时，会执行 TcpServer::newConnection（轮询，分发操作）
     acceptor_->setNewConnectionCallback(
@@ -45,15 +56,18 @@ TcpServer::TcpServer(EventLoop* loop, const InetAddress& listenAddr, const std::
 
 
 TcpServer::~TcpServer(){
-    for(auto& item : connections_){
-        // 这个局部的强 shared_ptr 智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象资源
-        // 如果直接item.second.reset()，释放了new出来的TcpConnection对象资源，则无法再调用TcpConnection::connectDestroyed
-        TcpConnectionPtr conn(item.second);     
-        item.second.reset();
+    // 同步注销：返回后其他subloop中的 release 不会再调用到这个 TcpServer
+    if(budgetSubscription_ != 0){
+        MemoryBudget::instance().removeRecoverCallback(budgetSubscription_);
+        budgetSubscription_ = 0;
+    }
 
+    // 先把连接交给各自的subloop执行 connectDestroyed（任务中持有 shared_ptr），再清空表，释放表中的引用
+    connections_.forEach([](const TcpConnectionPtr& conn){
         conn->getLoop()->runInLoop(
             std::bind(&TcpConnection::connectDestroyed, conn));
-    }
+    });
+    connections_.clear();
 }
 
 
@@ -80,44 +94,77 @@ void TcpServer::start(){
             TcpServer => Acceptor => Channel => Poller
 */
 void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr){
+    uint64_t traceId = Tracer::currentId();
+    TraceSpan span("TcpServer::newConnection", traceId);
+    MUDUO_ALLOC_SITE("TcpServer::newConnection");
     // 轮询算法，选择一个subloop，来管理对应的channel
     EventLoop* ioLoop = threadPool_->getNextLoop();
-    char buf[64];
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;  // newConnection 只有在mainloop中处理，不涉及多线程，所以不需要定义为原子类型
-    std::string connName = name_ + buf;
-
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from [%s] \n",
-        name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
-
-    // 通过sockfd获取其绑定的本机的ip地址和端口信息 localAddr
-    sockaddr_in local;
-    ::bzero(&local, sizeof(local));     // ::memset(&local, 0, sizeof(local));
-    socklen_t addrlen = sizeof local;
-    if(::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0){
-        LOG_ERROR("sockets::getLocalAddr errno:%d \n", errno);
-    }
-    InetAddress localAddr(local);
-
-    // 根据连接成功的 sockfd，创建TcpConnection连接对象
-    TcpConnectionPtr conn(
-        new TcpConnection(ioLoop,
-                          connName,
-                          sockfd,       // Socket Channel 
-                          localAddr,
-                          peerAddr)
-    );
-    connections_[connName] = conn;
-    // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));  // 设置如何关闭连接的回调
+    // newConnection 只有在mainloop中处理，不涉及多线程，connections_ 不需要加锁
+    uint64_t connId = connections_.acquire();
+
+    // 本机的ip地址和端口信息 localAddr：监听的是具体地址时直接用 Acceptor 缓存的地址，监听通配地址时才需要通过 sockfd 获取
+    InetAddress localAddr;
+    if(acceptor_->hasFixedLocalAddr()){
+        localAddr = acceptor_->getLocalAddr();
+    }else{
+        sockaddr_in local;
+        ::bzero(&local, sizeof(local));     // ::memset(&local, 0, sizeof(local));
+        socklen_t addrlen = sizeof local;
+        if(::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0){
+            LOG_ERROR("sockets::getLocalAddr errno:%d \n", errno);
+        }
+        localAddr.setSockAddr(local);
+    }
+
+    // 根据连接成功的 sockfd，创建TcpConnection连接对象。make_shared 把控制块和对象放在同一次分配中
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(ioLoop,
+                                                            connId,
+                                                            connNamePrefix_,
+                                                            sockfd,       // Socket Channel 
+                                                            localAddr,
+                                                            peerAddr);
+    connections_.set(connId, conn);
+
+    // 连接名只在日志开启时才格式化，逐连接的日志放在 DEBUG 级别，默认的 INFO 级别下不会格式化
+    LOG_DEBUG("TcpServer::newConnection [%s] - new connection [%s] from [%s] \n",
+        name_.c_str(), conn->getName().c_str(), peerAddr.toIpPort().c_str());
+    conn->setTraceId(traceId);
+    // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调，所有连接共享同一份
+    conn->setCallbacks(connectionCallbacks());
+    if(highWaterMarkCallback_){
+        conn->setHighWaterMark(highWaterMark_);
+    }
+    if(pauseReadMark_ > 0){
+        conn->setReadFlowControl(pauseReadMark_, resumeReadMark_);
+    }
 
     // 直接调用TcpConnection::connectEstablished，执行了用户设置的连接建立回调
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    ioLoop->runInLoop(Tracer::hop("TcpConnection::connectEstablished", traceId,
+                                  std::bind(&TcpConnection::connectEstablished, conn)));
+}
+
+
+/*
+函数功能：
+    组装所有连接共享的回调集合，回调没有变化时一直复用同一份
+其他解释：
+    以前每个连接各拷贝一遍 7 个 std::function，其中 bind 出来的超过了 std::function 的内部存储，每个都是一次堆分配
+*/
+const ConnectionCallbacksPtr& TcpServer::connectionCallbacks(){
+    if(!callbacks_){
+        std::shared_ptr<ConnectionCallbacks> callbacks = std::make_shared<ConnectionCallbacks>();
+        callbacks->connection = connectionCallback_;
+        callbacks->message = messageCallback_;
+        callbacks->timestampedMessage = timestampedMessageCallback_;
+        callbacks->writeComplete = writeCompleteCallback_;
+        callbacks->highWaterMark = highWaterMarkCallback_;
+        callbacks->close = std::bind(&TcpServer::removeConnection, this, std::placeholders::_1);  // 设置如何关闭连接的回调
+        if(budgetEnabled_){
+            callbacks->memoryBudget = std::bind(&TcpServer::onMemoryBudgetExceeded, this, std::placeholders::_1);
+        }
+        callbacks_ = callbacks;
+    }
+    return callbacks_;
 }
 
 
@@ -128,13 +175,157 @@ void TcpServer::removeConnection(const TcpConnectionPtr& conn){
 
 
 void TcpServer::removeConnectionInLoop(const TcpConnectionPtr& conn){
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection [%s] \n", 
+    LOG_DEBUG("TcpServer::removeConnectionInLoop [%s] - connection [%s] \n", 
                 name_.c_str(), conn->getName().c_str());
     
-    size_t n = connections_.erase(conn->getName());
+    connections_.remove(conn->getId());
     EventLoop* ioLoop = conn->getLoop();
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn));
 }
 
 
+// 设置所有连接缓冲区的内存预算，以及超出预算时的处理策略
+void TcpServer::setMemoryBudget(size_t limit, MemoryBudgetPolicy policy){
+    MemoryBudget& budget = MemoryBudget::instance();
+    budget.setLimit(limit);
+    budgetEnabled_ = limit > 0;
+    budgetPolicy_ = policy;
+    callbacks_.reset();
+    if(budgetSubscription_ != 0){
+        budget.removeRecoverCallback(budgetSubscription_);
+        budgetSubscription_ = 0;
+    }
+    if(budgetEnabled_){
+        budgetSubscription_ = budget.addRecoverCallback(std::bind(&TcpServer::onMemoryBudgetRecovered, this));
+    }
+}
+
+
+size_t TcpServer::bufferedMemory() const{
+    size_t total = 0;
+    connections_.forEach([&total](const TcpConnectionPtr& conn){
+        total += conn->bufferedMemory();
+    });
+    return total;
+}
+
+
+/*
+函数功能：
+    连接的缓冲区增长时发现超出了内存预算，按 budgetPolicy_ 处理。在连接所在的subloop中执行
+*/
+void TcpServer::onMemoryBudgetExceeded(const TcpConnectionPtr& conn){
+    switch (budgetPolicy_){
+    case kStopReading:
+        if(conn->isReading()){
+            LOG_ERROR("TcpServer::onMemoryBudgetExceeded [%s] - stop reading [%s], used:%lu limit:%lu\n",
+                        name_.c_str(), conn->getName().c_str(), 
+                        MemoryBudget::instance().used(), MemoryBudget::instance().limit());
+            conn->pauseReadForBudget();
+            {
+                std::unique_lock<std::mutex> lock(budgetMutex_);
+                budgetPaused_.push_back(conn);
+            }
+            // 暂停之前内存可能已经回落，此时不会再有回落的通知
+            if(MemoryBudget::instance().used() <= MemoryBudget::instance().lowWaterMark()){
+                onMemoryBudgetRecovered();
+            }
+        }
+        break;
+    case kShedLargest:
+        if(!shedQueued_.exchange(true)){
+            loop_->queueInLoop(std::bind(&TcpServer::shedLargestInLoop, this));
+        }
+        break;
+    case kCloseConnection:
+        LOG_ERROR("TcpServer::onMemoryBudgetExceeded [%s] - close [%s], used:%lu limit:%lu\n",
+                    name_.c_str(), conn->getName().c_str(), 
+                    MemoryBudget::instance().used(), MemoryBudget::instance().limit());
+        conn->forceClose();
+        break;
+    default:
+        break;
+    }
+}
+
+
+// 内存回落到低水位以下，转到 baseloop 中恢复被暂停读的连接
+void TcpServer::onMemoryBudgetRecovered(){
+    bool hasPaused = false;
+    {
+        std::unique_lock<std::mutex> lock(budgetMutex_);
+        hasPaused = !budgetPaused_.empty();
+    }
+    if(hasPaused){
+        loop_->queueInLoop(std::bind(&TcpServer::resumeBudgetPausedInLoop, this));
+    }
+}
+
+
+void TcpServer::resumeBudgetPausedInLoop(){
+    std::vector<std::weak_ptr<TcpConnection>> paused;
+    {
+        std::unique_lock<std::mutex> lock(budgetMutex_);
+        paused.swap(budgetPaused_);
+    }
+
+    for(const std::weak_ptr<TcpConnection>& item : paused){
+        TcpConnectionPtr conn = item.lock();
+        if(conn){
+            conn->resumeReadForBudget();        // 不影响读流控：流控仍在暂停的连接由流控自己恢复
+        }
+    }
+}
+
+
+/*
+函数功能：
+    关闭占用缓冲区内存最多的连接。connections_ 只在 baseloop 中访问，各连接的占用是原子变量，直接读取
+*/
+void TcpServer::shedLargestInLoop(){
+    shedQueued_ = false;
+    if(!MemoryBudget::instance().exceeded()){
+        return;
+    }
+
+    TcpConnectionPtr largest;
+    size_t largestBytes = 0;
+    connections_.forEach([&](const TcpConnectionPtr& conn){
+        size_t bytes = conn->bufferedMemory();
+        if(bytes > largestBytes){
+            largestBytes = bytes;
+            largest = conn;
+        }
+    });
+
+    if(largest){
+        LOG_ERROR("TcpServer::shedLargestInLoop [%s] - close [%s] holding %lu bytes, used:%lu limit:%lu\n",
+                    name_.c_str(), largest->getName().c_str(), largestBytes,
+                    MemoryBudget::instance().used(), MemoryBudget::instance().limit());
+        largest->forceClose();
+    }
+}
+
+
+std::vector<TcpServer::ConnectionStat> TcpServer::topConnectionsByMemory(size_t n) const{
+    // 先按占用排序，只给最后留下的 n 个连接格式化名字和地址
+    using Entry = std::pair<size_t, TcpConnectionPtr>;
+    std::vector<Entry> entries;
+    entries.reserve(connections_.size());
+    connections_.forEach([&entries](const TcpConnectionPtr& conn){
+        entries.push_back(Entry(conn->bufferedMemory(), conn));
+    });
+
+    n = std::min(n, entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + n, entries.end(),
+        [](const Entry& a, const Entry& b){ return a.first > b.first; });
+
+    std::vector<ConnectionStat> stats;
+    stats.reserve(n);
+    for(size_t i = 0; i < n; ++i){
+        const TcpConnectionPtr& conn = entries[i].second;
+        stats.push_back(ConnectionStat{conn->getName(), conn->getPeerAddrress().toIpPort(), entries[i].first});
+    }
+    return stats;
+}
@@ -1,33 +1,93 @@
 #include "Timestamp.h"
-#include <sys/time.h>
 
-Timestamp::Timestamp() 
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+
+// 每个线程缓存最近一次格式化的秒：同一秒直接复用，同一分钟只改写最后两位秒数
+namespace {
+    __thread time_t t_lastSecond = -1;
+    __thread time_t t_lastMinute = -1;
+    __thread char t_time[32];           // "2024/01/01 12:00:00"
+    __thread size_t t_timeLen = 0;
+}
+
+
+Timestamp::Timestamp()
     : microSecondsSinceEpoch_(0){}
 
-Timestamp::Timestamp(int64_t microSecondsSinceEpoch) 
+Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
     : microSecondsSinceEpoch_(microSecondsSinceEpoch){}
 
+
+// CLOCK_REALTIME 走 vDSO，不需要系统调用
 Timestamp Timestamp::now(){
-    return Timestamp(time(NULL));
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return Timestamp(static_cast<int64_t>(ts.tv_sec) * kMicroSecondsPerSecond + ts.tv_nsec / 1000);
 }
 
+
+/*
+函数功能：
+    把时间格式化为 2024/01/01 12:00:00[.123456]，写入 buf
+其他解释：
+    日期前缀按线程缓存，跨分钟（时区、夏令时可能变化）时才重新调用 localtime_r
+*/
+size_t Timestamp::formatTo(char* buf, size_t len, bool showMicroseconds) const{
+    time_t seconds = secondsSinceEpoch();
+    if(seconds != t_lastSecond){
+        time_t minute = seconds / 60;
+        if(minute != t_lastMinute){
+            struct tm tm_time;
+            ::localtime_r(&seconds, &tm_time);
+            int n = snprintf(t_time, sizeof t_time, "%4d/%02d/%02d %02d:%02d:%02d",
+                            tm_time.tm_year + 1900,
+                            tm_time.tm_mon + 1,
+                            tm_time.tm_mday,
+                            tm_time.tm_hour,
+                            tm_time.tm_min,
+                            tm_time.tm_sec);
+            t_timeLen = n > 0 ? static_cast<size_t>(n) : 0;
+            t_lastMinute = minute;
+        }else{
+            int sec = static_cast<int>(seconds % 60);
+            t_time[t_timeLen - 2] = static_cast<char>('0' + sec / 10);
+            t_time[t_timeLen - 1] = static_cast<char>('0' + sec % 10);
+        }
+        t_lastSecond = seconds;
+    }
+
+    if(len == 0){
+        return 0;
+    }
+    size_t n = t_timeLen < len - 1 ? t_timeLen : len - 1;
+    memcpy(buf, t_time, n);
+    if(showMicroseconds && len - n > 7){
+        int micros = static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond);
+        n += snprintf(buf + n, len - n, ".%06d", micros);
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+
 std::string Timestamp::toString() const{      // 常量成员函数
-    char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);  // 返回值是tm的结构体指针
-    snprintf(buf, sizeof(buf), "%4d/%02d/%02d %02d:%02d:%02d",
-               tm_time->tm_year + 1900, 
-               tm_time->tm_mon + 1, 
-               tm_time->tm_mday,
-               tm_time->tm_hour, 
-               tm_time->tm_min, 
-               tm_time->tm_sec);
-    return buf;
+    return toFormattedString(false);
+}
+
+
+std::string Timestamp::toFormattedString(bool showMicroseconds) const{
+    char buf[64];
+    size_t n = formatTo(buf, sizeof buf, showMicroseconds);
+    return std::string(buf, n);
 }
 
 
 /*
     右键选择，Run Code
-*/ 
+*/
 // #include <iostream>
 // int main(){
 //     std::cout << Timestamp::now().toString() << std::endl;
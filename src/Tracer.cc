@@ -0,0 +1,245 @@
+#include "Tracer.h"
+#include "CurrentThread.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <time.h>
+#include <stdio.h>
+#include <unistd.h>         // getpid
+#include <sys/prctl.h>      // PR_GET_NAME
+
+
+namespace {
+    const size_t kRingSize = 8192;     // 每个线程保留的事件数（2 的幂）
+
+    enum Phase : char { kComplete = 'X', kFlowStart = 's', kFlowEnd = 'f' };
+
+    struct Event{
+        const char* name;
+        uint64_t traceId;
+        uint64_t flowId;
+        int64_t startNs;
+        int64_t durNs;
+        char phase;
+    };
+
+    /*
+        环形缓冲区的一个槽位，字段都是 relaxed 原子变量，用 seq 做顺序锁（只有所属线程写）：
+        写第 p 个事件之前 seq 变成奇数 2p+1，写完变成 2p+2。导出线程前后两次读到 2i+2 才说明复制到的是完整的第 i 个事件
+    */
+    struct Slot{
+        void store(uint64_t p, const Event& e){
+            seq.store(2 * p + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            name.store(e.name, std::memory_order_relaxed);
+            traceId.store(e.traceId, std::memory_order_relaxed);
+            flowId.store(e.flowId, std::memory_order_relaxed);
+            startNs.store(e.startNs, std::memory_order_relaxed);
+            durNs.store(e.durNs, std::memory_order_relaxed);
+            phase.store(e.phase, std::memory_order_relaxed);
+            seq.store(2 * p + 2, std::memory_order_release);
+        }
+
+        // 读出第 i 个事件，槽位已经被覆盖或者正在被写入时返回 false
+        bool load(uint64_t i, Event* e) const{
+            uint64_t expected = 2 * i + 2;
+            if(seq.load(std::memory_order_acquire) != expected){
+                return false;
+            }
+            e->name = name.load(std::memory_order_relaxed);
+            e->traceId = traceId.load(std::memory_order_relaxed);
+            e->flowId = flowId.load(std::memory_order_relaxed);
+            e->startNs = startNs.load(std::memory_order_relaxed);
+            e->durNs = durNs.load(std::memory_order_relaxed);
+            e->phase = phase.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return seq.load(std::memory_order_relaxed) == expected;
+        }
+
+        std::atomic<uint64_t> seq{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> traceId{0};
+        std::atomic<uint64_t> flowId{0};
+        std::atomic<int64_t> startNs{0};
+        std::atomic<int64_t> durNs{0};
+        std::atomic<char> phase{0};
+    };
+
+    // 每个线程一个，第一次记录事件时创建。线程退出后保留（其中的事件还要导出），不释放
+    struct Ring{
+        Ring() : tid(CurrentThread::getTid()), pos(0), slots(kRingSize) {
+            char name[17] = { 0 };
+            ::prctl(PR_GET_NAME, name);
+            threadName = name;
+        }
+
+        void push(const Event& e){
+            uint64_t p = pos.load(std::memory_order_relaxed);
+            slots[p & (kRingSize - 1)].store(p, e);
+            pos.store(p + 1, std::memory_order_release);
+        }
+
+        const int tid;
+        std::string threadName;
+        std::atomic<uint64_t> pos;      // 已写入的事件总数
+        std::vector<Slot> slots;
+    };
+
+    std::atomic_int g_sampleRate(0);
+    std::atomic<uint64_t> g_nextTraceId(0);
+    std::atomic<uint64_t> g_nextFlowId(0);
+
+    std::mutex g_ringsMutex;
+    std::vector<Ring*> g_rings;
+
+    __thread Ring* t_ring = nullptr;
+    __thread uint64_t t_currentId = 0;
+    __thread uint32_t t_sampleCounter = 0;
+
+    Ring* threadRing(){
+        if(__builtin_expect(t_ring == nullptr, 0)){
+            t_ring = new Ring;
+            std::lock_guard<std::mutex> lock(g_ringsMutex);
+            g_rings.push_back(t_ring);
+        }
+        return t_ring;
+    }
+
+    void appendJsonEvent(std::string& out, const Event& e, int pid, int tid){
+        char buf[256];
+        double tsMicros = e.startNs / 1000.0;
+        if(e.phase == kComplete){
+            snprintf(buf, sizeof buf,
+                     "{\"name\":\"%s\",\"cat\":\"muduo\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                     "\"pid\":%d,\"tid\":%d,\"args\":{\"trace\":%lu}},\n",
+                     e.name, tsMicros, e.durNs / 1000.0, pid, tid, e.traceId);
+        }else{
+            // flow 终点绑定到包含它的 span（bp:e），起点默认绑定到包含它的 span
+            snprintf(buf, sizeof buf,
+                     "{\"name\":\"%s\",\"cat\":\"muduo\",\"ph\":\"%c\",%s\"id\":%lu,\"ts\":%.3f,"
+                     "\"pid\":%d,\"tid\":%d,\"args\":{\"trace\":%lu}},\n",
+                     e.name, e.phase, e.phase == kFlowEnd ? "\"bp\":\"e\"," : "", e.flowId, tsMicros,
+                     pid, tid, e.traceId);
+        }
+        out += buf;
+    }
+}
+
+
+void Tracer::setSampleRate(int oneInN){
+    g_sampleRate.store(oneInN > 0 ? oneInN : 0, std::memory_order_relaxed);
+}
+
+
+int Tracer::sampleRate(){
+    return g_sampleRate.load(std::memory_order_relaxed);
+}
+
+
+uint64_t Tracer::sample(){
+    int rate = g_sampleRate.load(std::memory_order_relaxed);
+    if(rate == 0 || ++t_sampleCounter % static_cast<uint32_t>(rate) != 0){
+        return 0;
+    }
+    return g_nextTraceId.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+
+uint64_t Tracer::currentId(){
+    return t_currentId;
+}
+
+
+uint64_t Tracer::exchangeCurrentId(uint64_t traceId){
+    uint64_t prev = t_currentId;
+    t_currentId = traceId;
+    return prev;
+}
+
+
+int64_t Tracer::nowNanos(){
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+void Tracer::recordSpan(const char* name, uint64_t traceId, int64_t startNs, int64_t endNs){
+    Event e = { name, traceId, 0, startNs, endNs - startNs, kComplete };
+    threadRing()->push(e);
+}
+
+
+/*
+函数功能：
+    记录 flow 起点，返回的任务在目标线程中执行时先打开 span 并记录 flow 终点，再执行 cb
+其他解释：
+    起点和终点的时间差就是任务在目标 loop 的 pendingFunctors_ 中排队（加上唤醒）的时间
+*/
+Tracer::Functor Tracer::hop(const char* name, uint64_t traceId, Functor cb){
+    if(traceId == 0){
+        return cb;
+    }
+
+    uint64_t flowId = g_nextFlowId.fetch_add(1, std::memory_order_relaxed) + 1;
+    Event start = { name, traceId, flowId, nowNanos(), 0, kFlowStart };
+    threadRing()->push(start);
+
+    return [name, traceId, flowId, cb](){
+        TraceSpan span(name, traceId);
+        Event end = { name, traceId, flowId, nowNanos(), 0, kFlowEnd };
+        threadRing()->push(end);
+        cb();
+    };
+}
+
+
+/*
+函数功能：
+    导出所有线程环形缓冲区中的事件
+其他解释：
+    写线程不会等待导出：每个槽位按顺序锁读取，复制期间被覆盖或者正在写入的槽位跳过。
+    复制完再检查写位置，写线程可能正在写第 after 个事件，它占用的是第 after - kRingSize 个事件的槽位，所以更早的事件都丢弃
+*/
+std::string Tracer::dumpChromeJson(){
+    std::vector<Ring*> rings;
+    {
+        std::lock_guard<std::mutex> lock(g_ringsMutex);
+        rings = g_rings;
+    }
+
+    int pid = ::getpid();
+    std::string out("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    char buf[128];
+    std::vector<Event> events;
+    for(Ring* ring : rings){
+        snprintf(buf, sizeof buf,
+                 "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                 pid, ring->tid, ring->threadName.c_str());
+        out += buf;
+
+        uint64_t end = ring->pos.load(std::memory_order_acquire);
+        uint64_t begin = end > kRingSize ? end - kRingSize : 0;
+        events.resize(end - begin);
+        std::vector<bool> loaded(end - begin);
+        for(uint64_t i = begin; i < end; ++i){
+            loaded[i - begin] = ring->slots[i & (kRingSize - 1)].load(i, &events[i - begin]);
+        }
+
+        uint64_t after = ring->pos.load(std::memory_order_acquire);
+        uint64_t valid = after + 1 > kRingSize ? after + 1 - kRingSize : 0;
+        for(uint64_t i = begin; i < end; ++i){
+            if(i >= valid && loaded[i - begin]){
+                appendJsonEvent(out, events[i - begin], pid, ring->tid);
+            }
+        }
+    }
+
+    // 去掉最后一个事件后面的逗号
+    if(out.size() >= 2 && out[out.size() - 2] == ','){
+        out.erase(out.size() - 2, 1);
+    }
+    out += "]}\n";
+    return out;
+}
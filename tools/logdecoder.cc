@@ -0,0 +1,406 @@
+/*
+    logdecoder：把 BinaryLogger 写出的二进制日志还原成和 Logger 一样的文本行
+        用法：logdecoder file1.log [file2.log ...]
+        输出：[INFO]2024/01/01 12:00:00.123456 tid : 消息 - file:line
+
+    只依赖文件格式（见 include/BinaryLog.h），不链接 muduocpp11
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace {
+
+enum ArgType : uint8_t {
+    kArgInt64 = 1,
+    kArgUInt64,
+    kArgDouble,
+    kArgPointer,
+    kArgString,
+};
+
+enum EntryType : uint8_t {
+    kEntrySite = 1,
+    kEntryRecords,
+    kEntryCalibrate,
+    kEntryDropped,
+};
+
+const size_t kRecordHeaderSize = 16;
+const char kFileMagic[] = "MUDUOBL1";
+const char* const kLevelNames[] = { "[DEBUG]", "[INFO]", "[ERROR]", "[FATAL]" };
+
+struct Site{
+    int level;
+    int line;
+    std::string file;
+    std::string fmt;
+};
+
+struct Arg{
+    uint8_t type;
+    uint64_t bits;          // 整数、浮点数、指针的原始 8 字节
+    std::string str;
+};
+
+struct Calibration{
+    uint64_t ticks = 0;
+    uint64_t ns = 0;
+    double ticksPerNs = 0.0;
+};
+
+
+// 按顺序读取文件内容，越界时 ok_ 置为 false
+class Reader{
+public:
+    Reader(const char* data, size_t len) : data_(data), len_(len), pos_(0), ok_(true) {}
+
+    template <typename T>
+    T read(){
+        T v = T();
+        if(pos_ + sizeof v > len_){
+            ok_ = false;
+            pos_ = len_;
+            return v;
+        }
+        memcpy(&v, data_ + pos_, sizeof v);
+        pos_ += sizeof v;
+        return v;
+    }
+
+    std::string readString(size_t n){
+        if(pos_ + n > len_){
+            ok_ = false;
+            pos_ = len_;
+            return std::string();
+        }
+        std::string s(data_ + pos_, n);
+        pos_ += n;
+        return s;
+    }
+
+    const char* current() const { return data_ + pos_; }
+    void skip(size_t n) { pos_ = pos_ + n > len_ ? len_ : pos_ + n; }
+    size_t remain() const { return len_ - pos_; }
+    bool ok() const { return ok_; }
+
+private:
+    const char* data_;
+    size_t len_;
+    size_t pos_;
+    bool ok_;
+};
+
+
+void appendArgAsText(std::string& out, const Arg& arg){
+    char buf[64];
+    switch(arg.type){
+    case kArgInt64:
+        snprintf(buf, sizeof buf, "%lld", static_cast<long long>(arg.bits));
+        break;
+    case kArgUInt64:
+        snprintf(buf, sizeof buf, "%llu", static_cast<unsigned long long>(arg.bits));
+        break;
+    case kArgDouble:{
+        double d;
+        memcpy(&d, &arg.bits, sizeof d);
+        snprintf(buf, sizeof buf, "%g", d);
+        break;
+    }
+    case kArgPointer:
+        snprintf(buf, sizeof buf, "%p", reinterpret_cast<void*>(arg.bits));
+        break;
+    case kArgString:
+        out += arg.str;
+        return;
+    default:
+        snprintf(buf, sizeof buf, "<missing>");
+        break;
+    }
+    out += buf;
+}
+
+
+/*
+函数功能：
+    用记录中的参数重新展开 printf 格式串。每个转换说明单独交给 snprintf，
+    去掉长度修饰符后按参数的实际类型补上 ll，参数类型和转换说明对不上时按参数类型输出
+*/
+std::string format(const std::string& fmt, const std::vector<Arg>& args){
+    std::string out;
+    size_t next = 0;
+    static const Arg kMissing = Arg{0, 0, std::string()};
+    auto nextArg = [&]() -> const Arg& { return next < args.size() ? args[next++] : kMissing; };
+
+    for(size_t i = 0; i < fmt.size(); ++i){
+        char c = fmt[i];
+        if(c != '%'){
+            out += c;
+            continue;
+        }
+        if(i + 1 < fmt.size() && fmt[i + 1] == '%'){
+            out += '%';
+            ++i;
+            continue;
+        }
+
+        // 转换说明：%[flags][width][.precision][length]conversion
+        std::string spec("%");
+        std::vector<int> starArgs;
+        size_t j = i + 1;
+        while(j < fmt.size() && strchr("-+ #0'", fmt[j])){
+            spec += fmt[j++];
+        }
+        for(int part = 0; part < 2; ++part){
+            if(part == 1){
+                if(j >= fmt.size() || fmt[j] != '.'){
+                    break;
+                }
+                spec += fmt[j++];
+            }
+            if(j < fmt.size() && fmt[j] == '*'){
+                spec += '*';
+                starArgs.push_back(static_cast<int>(nextArg().bits));
+                ++j;
+            }
+            while(j < fmt.size() && fmt[j] >= '0' && fmt[j] <= '9'){
+                spec += fmt[j++];
+            }
+        }
+        while(j < fmt.size() && strchr("hlLqjzt", fmt[j])){
+            ++j;
+        }
+        if(j >= fmt.size()){
+            out += fmt.substr(i);
+            break;
+        }
+        char conv = fmt[j];
+        i = j;
+
+        const Arg& arg = nextArg();
+        char buf[512];
+        int n = -1;
+        bool isInt = arg.type == kArgInt64 || arg.type == kArgUInt64;
+        int w = starArgs.size() > 0 ? starArgs[0] : 0;
+        int p = starArgs.size() > 1 ? starArgs[1] : 0;
+
+        if(strchr("dioux", conv) || conv == 'X'){
+            if(isInt){
+                std::string s = spec + "ll" + conv;
+                long long v = static_cast<long long>(arg.bits);
+                n = starArgs.size() == 2 ? snprintf(buf, sizeof buf, s.c_str(), w, p, v)
+                  : starArgs.size() == 1 ? snprintf(buf, sizeof buf, s.c_str(), w, v)
+                  : snprintf(buf, sizeof buf, s.c_str(), v);
+            }
+        }else if(conv == 'c'){
+            if(isInt){
+                std::string s = spec + conv;
+                n = snprintf(buf, sizeof buf, s.c_str(), static_cast<int>(arg.bits));
+            }
+        }else if(strchr("fFeEgGaA", conv)){
+            if(arg.type == kArgDouble){
+                std::string s = spec + conv;
+                double d;
+                memcpy(&d, &arg.bits, sizeof d);
+                n = starArgs.size() == 2 ? snprintf(buf, sizeof buf, s.c_str(), w, p, d)
+                  : starArgs.size() == 1 ? snprintf(buf, sizeof buf, s.c_str(), w, d)
+                  : snprintf(buf, sizeof buf, s.c_str(), d);
+            }
+        }else if(conv == 's'){
+            if(arg.type == kArgString){
+                std::string s = spec + conv;
+                n = starArgs.size() == 2 ? snprintf(buf, sizeof buf, s.c_str(), w, p, arg.str.c_str())
+                  : starArgs.size() == 1 ? snprintf(buf, sizeof buf, s.c_str(), w, arg.str.c_str())
+                  : snprintf(buf, sizeof buf, s.c_str(), arg.str.c_str());
+            }
+        }else if(conv == 'p'){
+            if(arg.type == kArgPointer || isInt){
+                n = snprintf(buf, sizeof buf, "%p", reinterpret_cast<void*>(arg.bits));
+            }
+        }
+
+        if(n >= 0){
+            out.append(buf, static_cast<size_t>(n) < sizeof buf ? n : sizeof buf - 1);
+        }else{
+            appendArgAsText(out, arg);
+        }
+    }
+    return out;
+}
+
+
+class Decoder{
+public:
+    bool decodeFile(const char* path);
+
+private:
+    void decodeRecords(uint32_t tid, Reader& chunk);
+    void printTime(uint64_t ticks, char* buf, size_t len) const;
+
+    std::unordered_map<uint32_t, Site> sites_;
+    Calibration calibration_;
+};
+
+
+void Decoder::printTime(uint64_t ticks, char* buf, size_t len) const{
+    double deltaNs = 0.0;
+    if(calibration_.ticksPerNs > 0){
+        deltaNs = static_cast<double>(static_cast<int64_t>(ticks - calibration_.ticks)) / calibration_.ticksPerNs;
+    }
+    int64_t ns = static_cast<int64_t>(calibration_.ns) + static_cast<int64_t>(deltaNs);
+    time_t seconds = static_cast<time_t>(ns / 1000000000);
+    int micros = static_cast<int>(ns % 1000000000 / 1000);
+    struct tm tm_time;
+    localtime_r(&seconds, &tm_time);
+    snprintf(buf, len, "%4d/%02d/%02d %02d:%02d:%02d.%06d",
+             tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+             tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec, micros);
+}
+
+
+void Decoder::decodeRecords(uint32_t tid, Reader& chunk){
+    std::vector<Arg> args;
+    while(chunk.remain() >= kRecordHeaderSize){
+        const char* start = chunk.current();
+        uint32_t siteId = chunk.read<uint32_t>();
+        uint32_t length = chunk.read<uint32_t>();
+        uint64_t ticks = chunk.read<uint64_t>();
+        if(length < kRecordHeaderSize || length - kRecordHeaderSize > chunk.remain()){
+            fprintf(stderr, "logdecoder: corrupted record\n");
+            return;
+        }
+
+        // 参数区的末尾可能有对齐用的 0
+        Reader argReader(start + kRecordHeaderSize, length - kRecordHeaderSize);
+        args.clear();
+        while(argReader.remain() > 0){
+            Arg arg;
+            arg.type = argReader.read<uint8_t>();
+            arg.bits = 0;
+            if(arg.type == 0){
+                break;
+            }else if(arg.type == kArgString){
+                uint16_t len = argReader.read<uint16_t>();
+                arg.str = argReader.readString(len);
+            }else{
+                arg.bits = argReader.read<uint64_t>();
+            }
+            if(!argReader.ok()){
+                break;
+            }
+            args.push_back(arg);
+        }
+        chunk.skip(length - kRecordHeaderSize);
+
+        char timebuf[64];
+        printTime(ticks, timebuf, sizeof timebuf);
+        auto it = sites_.find(siteId);
+        if(it == sites_.end()){
+            printf("[UNKNOWN]%s %u : site %u\n", timebuf, tid, siteId);
+            continue;
+        }
+        const Site& site = it->second;
+        const char* level = site.level >= 0 && site.level < 4 ? kLevelNames[site.level] : "[?]";
+        std::string msg = format(site.fmt, args);
+        printf("%s%s %u : %s - %s:%d\n", level, timebuf, tid, msg.c_str(), site.file.c_str(), site.line);
+    }
+}
+
+
+bool Decoder::decodeFile(const char* path){
+    FILE* fp = fopen(path, "rb");
+    if(fp == nullptr){
+        fprintf(stderr, "logdecoder: cannot open %s\n", path);
+        return false;
+    }
+    std::string content;
+    char buf[64*1024];
+    size_t n = 0;
+    while((n = fread(buf, 1, sizeof buf, fp)) > 0){
+        content.append(buf, n);
+    }
+    fclose(fp);
+
+    Reader reader(content.data(), content.size());
+    if(reader.readString(sizeof kFileMagic - 1) != kFileMagic){
+        fprintf(stderr, "logdecoder: %s is not a binary log\n", path);
+        return false;
+    }
+
+    while(reader.remain() > 0 && reader.ok()){
+        // 同一个进程在同一秒内重新打开的文件会追加在后面，再次出现文件头
+        if(reader.remain() >= sizeof kFileMagic - 1
+            && memcmp(reader.current(), kFileMagic, sizeof kFileMagic - 1) == 0){
+            reader.skip(sizeof kFileMagic - 1);
+            continue;
+        }
+
+        uint8_t type = reader.read<uint8_t>();
+        if(type == 0){
+            // 进程崩溃时 LogFile 没有截断文件，后面是预分配的 0
+            break;
+        }
+        switch(type){
+        case kEntrySite:{
+            uint32_t id = reader.read<uint32_t>();
+            Site site;
+            site.level = reader.read<uint8_t>();
+            site.line = static_cast<int>(reader.read<uint32_t>());
+            site.file = reader.readString(reader.read<uint16_t>());
+            site.fmt = reader.readString(reader.read<uint16_t>());
+            sites_[id] = site;
+            break;
+        }
+        case kEntryRecords:{
+            uint32_t tid = reader.read<uint32_t>();
+            uint32_t bytes = reader.read<uint32_t>();
+            if(bytes > reader.remain()){
+                fprintf(stderr, "logdecoder: %s truncated\n", path);
+                return false;
+            }
+            Reader chunk(reader.current(), bytes);
+            decodeRecords(tid, chunk);
+            reader.skip(bytes);
+            break;
+        }
+        case kEntryCalibrate:
+            calibration_.ticks = reader.read<uint64_t>();
+            calibration_.ns = reader.read<uint64_t>();
+            calibration_.ticksPerNs = reader.read<double>();
+            break;
+        case kEntryDropped:{
+            uint32_t tid = reader.read<uint32_t>();
+            uint64_t dropped = reader.read<uint64_t>();
+            printf("[DROPPED] tid %u dropped %llu messages in total\n", tid, static_cast<unsigned long long>(dropped));
+            break;
+        }
+        default:
+            fprintf(stderr, "logdecoder: unknown entry %u in %s\n", type, path);
+            return false;
+        }
+    }
+    return reader.ok();
+}
+
+}   // namespace
+
+
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        fprintf(stderr, "Usage: %s binary-log-file...\n", argv[0]);
+        return 1;
+    }
+
+    int ret = 0;
+    for(int i = 1; i < argc; ++i){
+        Decoder decoder;
+        if(!decoder.decodeFile(argv[i])){
+            ret = 1;
+        }
+    }
+    return ret;
+}